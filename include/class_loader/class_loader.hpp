@@ -34,16 +34,27 @@
 
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <new>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "console_bridge/console.h"
 
 #include "class_loader/class_loader_core.hpp"
+#include "class_loader/load_executor.hpp"
 #include "class_loader/register_macro.hpp"
 #include "class_loader/visibility_control.hpp"
 
@@ -78,11 +89,508 @@ std::string systemLibraryFormat(const std::string & library_name);
 class ClassLoader
 {
 public:
+  /**
+   * @class PluginDeleter
+   * @brief The deleter of managed plugin instances: deletes the object and notifies the ClassLoader that created it. It only holds a pointer to the ClassLoader, so a UniquePtr is two pointers wide, and it converts to std::function<void(Base *)> for code that needs a type erased deleter.
+   */
+  template<typename Base>
+  class PluginDeleter
+  {
+public:
+    PluginDeleter()
+    : loader_(nullptr) {}
+
+    explicit PluginDeleter(ClassLoader * loader)
+    : loader_(loader) {}
+
+    void operator()(Base * obj) const
+    {
+      loader_->onPluginDeletion<Base>(obj);
+    }
+
+private:
+    ClassLoader * loader_;
+  };
+
+  template<typename Base>
+  using DeleterType = std::function<void (Base *)>;
+
+  template<typename Base>
+  using UniquePtr = std::unique_ptr<Base, PluginDeleter<Base>>;
+
+  /**
+   * @class PooledDeleter
+   * @brief The deleter of pooled plugin instances (@see ClassLoader::createPooledInstance()). It hands the instance back to the instance pool of its MetaObject instead of deleting it.
+   */
+  template<class Base>
+  class PooledDeleter
+  {
+public:
+    PooledDeleter()
+    : loader_(nullptr), meta_object_(nullptr), storage_(nullptr) {}
+
+    void operator()(Base * obj) const
+    {
+      if (nullptr == obj) {
+        return;
+      }
+      if (nullptr == storage_) {
+        // Allocated by the class's own operator new, not pooled
+        loader_->onPluginDeletion<Base>(obj);
+        return;
+      }
+      impl::InstancePool::Block block = {storage_, obj};
+      if (!meta_object_->resetForReuse(obj)) {
+        obj->~Base();
+        block.object = nullptr;
+      }
+      meta_object_->getInstancePool().release(block);
+      loader_->releasePluginReference();
+    }
+
+private:
+    friend class ClassLoader;
+
+    PooledDeleter(
+      ClassLoader * loader, impl::AbstractMetaObject<Base> * meta_object, void * storage)
+    : loader_(loader), meta_object_(meta_object), storage_(storage) {}
+
+    ClassLoader * loader_;
+    impl::AbstractMetaObject<Base> * meta_object_;
+    void * storage_;
+  };
+
   template<typename Base>
-  using DeleterType = std::function<void(Base *)>;
+  using PooledPtr = std::unique_ptr<Base, PooledDeleter<Base>>;
 
+  /**
+   * @class DeferredDeleter
+   * @brief The deleter of deferred plugin instances (@see ClassLoader::createDeferredInstance()). It queues the object to the background reclamation thread, which destroys it and releases it from the ClassLoader, so the deleting thread only pays for the queue push.
+   */
   template<typename Base>
-  using UniquePtr = std::unique_ptr<Base, DeleterType<Base>>;
+  class DeferredDeleter
+  {
+public:
+    DeferredDeleter()
+    : loader_(nullptr) {}
+
+    explicit DeferredDeleter(ClassLoader * loader)
+    : loader_(loader) {}
+
+    void operator()(Base * obj) const
+    {
+      if (nullptr != obj) {
+        loader_->queueDeferredDestruction(&ClassLoader::reclaimDeferredInstance<Base>, obj);
+      }
+    }
+
+private:
+    ClassLoader * loader_;
+  };
+
+  template<typename Base>
+  using DeferredPtr = std::unique_ptr<Base, DeferredDeleter<Base>>;
+
+  /**
+   * @struct DeferredDestructionStatistics
+   * @brief The state of the background reclamation thread shared by all ClassLoaders, @see ClassLoader::createDeferredInstance()
+   */
+  struct DeferredDestructionStatistics
+  {
+    /// Objects queued but not destroyed yet
+    std::size_t queue_depth;
+    /// The largest queue_depth so far
+    std::size_t max_queue_depth;
+    /// Objects destroyed so far
+    std::size_t destroyed;
+    /// Time from queueing to being destroyed, in total and the longest for a single object
+    std::chrono::nanoseconds total_latency;
+    std::chrono::nanoseconds max_latency;
+    /// Time spent in the destructors themselves, in total and the longest for a single object
+    std::chrono::nanoseconds total_destruction_time;
+    std::chrono::nanoseconds max_destruction_time;
+  };
+
+  /**
+   * @class InPlacePtr
+   * @brief A non-owning handle to a plugin object constructed in storage provided by the caller, as returned by ClassLoader::createInPlace(). Nothing happens when the handle goes out of scope: the object must be destroyed explicitly with destroy() before its storage is reused or freed.
+   *
+   * Until then the object counts as a live plugin object of its ClassLoader, which keeps the library loaded.
+   */
+  template<class Base>
+  class InPlacePtr
+  {
+public:
+    InPlacePtr()
+    : loader_(nullptr), obj_(nullptr) {}
+
+    Base * get() const {return obj_;}
+    Base * operator->() const {return obj_;}
+    Base & operator*() const {return *obj_;}
+    explicit operator bool() const {return nullptr != obj_;}
+
+    /**
+     * @brief Destroys the object, leaving its storage to the caller. Has no effect on an empty handle. Any copy of the handle is left dangling, like a copy of a raw pointer to a deleted object.
+     */
+    void destroy()
+    {
+      if (nullptr == obj_) {
+        return;
+      }
+      obj_->~Base();
+      obj_ = nullptr;
+      ClassLoader * loader = loader_;
+      loader_ = nullptr;
+      loader->releasePluginReference();
+    }
+
+private:
+    friend class ClassLoader;
+
+    InPlacePtr(ClassLoader * loader, Base * obj)
+    : loader_(loader), obj_(obj) {}
+
+    ClassLoader * loader_;
+    Base * obj_;
+  };
+
+  /**
+   * @class InstanceArray
+   * @brief Owns a batch of instances of one plugin class that were constructed next to each other in a single allocation, as returned by ClassLoader::createInstances(). The instances are destroyed (in reverse order) and the memory is freed all together when the array is destroyed.
+   *
+   * The whole batch counts as one live plugin object of its ClassLoader, see ClassLoader::Factory.
+   */
+  template<class Base>
+  class InstanceArray
+  {
+public:
+    /**
+     * @brief Iterates over the instances, which are objects of the same derived class spaced sizeof() that class apart
+     */
+    class iterator
+    {
+public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef Base value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef Base * pointer;
+      typedef Base & reference;
+
+      iterator()
+      : current_(nullptr), stride_(0) {}
+      iterator(Base * current, std::size_t stride)
+      : current_(current), stride_(stride) {}
+
+      reference operator*() const {return *current_;}
+      pointer operator->() const {return current_;}
+
+      iterator & operator++()
+      {
+        current_ = InstanceArray::advance(current_, stride_, 1);
+        return *this;
+      }
+
+      iterator operator++(int)
+      {
+        iterator copy(*this);
+        ++(*this);
+        return copy;
+      }
+
+      bool operator==(const iterator & other) const {return current_ == other.current_;}
+      bool operator!=(const iterator & other) const {return current_ != other.current_;}
+
+private:
+      Base * current_;
+      std::size_t stride_;
+    };
+
+    InstanceArray()
+    : loader_(nullptr), storage_(nullptr), first_(nullptr), stride_(0), size_(0) {}
+
+    InstanceArray(InstanceArray && other)
+    : InstanceArray()
+    {
+      swap(other);
+    }
+
+    InstanceArray & operator=(InstanceArray && other)
+    {
+      InstanceArray released(std::move(other));
+      swap(released);
+      return *this;
+    }
+
+    ~InstanceArray()
+    {
+      while (size_ > 0) {
+        --size_;
+        advance(first_, stride_, size_)->~Base();
+      }
+      ::operator delete(storage_);
+      if (nullptr != loader_) {
+        loader_->releasePluginReference();
+      }
+    }
+
+    void swap(InstanceArray & other)
+    {
+      std::swap(loader_, other.loader_);
+      std::swap(storage_, other.storage_);
+      std::swap(first_, other.first_);
+      std::swap(stride_, other.stride_);
+      std::swap(size_, other.size_);
+    }
+
+    std::size_t size() const {return size_;}
+    bool empty() const {return 0 == size_;}
+
+    Base & operator[](std::size_t index) const
+    {
+      assert(index < size_);
+      return *advance(first_, stride_, index);
+    }
+
+    iterator begin() const {return iterator(first_, stride_);}
+    iterator end() const {return iterator(advance(first_, stride_, size_), stride_);}
+
+private:
+    friend class ClassLoader;
+    InstanceArray(const InstanceArray &);
+    InstanceArray & operator=(const InstanceArray &);
+
+    /**
+     * @brief Moves from one instance to another one. The Base subobject is at the same offset in every instance, so this is a plain pointer offset.
+     */
+    static Base * advance(Base * obj, std::size_t stride, std::size_t count)
+    {
+      return reinterpret_cast<Base *>(reinterpret_cast<char *>(obj) + stride * count);
+    }
+
+    ClassLoader * loader_;
+    void * storage_;
+    Base * first_;
+    std::size_t stride_;
+    std::size_t size_;
+  };
+
+  /**
+   * @class Factory
+   * @brief A handle to the factory of one plugin class, as returned by ClassLoader::getFactory(). The class name lookup and the checks done by createInstance() happen once when the handle is created, so creating instances through the handle only costs the allocation and the constructor.
+   *
+   * A valid handle counts as a live plugin object of its ClassLoader: the library stays loaded for as long as the handle (or any instance created through it) exists, and in on-demand mode it is unloaded once the last of them goes away. Like plugin objects, handles must not outlive their ClassLoader.
+   */
+  template<class Base>
+  class Factory
+  {
+public:
+    Factory()
+    : loader_(nullptr), meta_object_(nullptr) {}
+
+    Factory(const Factory & other)
+    : loader_(other.loader_), meta_object_(other.meta_object_)
+    {
+      if (nullptr != loader_) {
+        loader_->acquirePluginReference();
+      }
+    }
+
+    Factory(Factory && other)
+    : loader_(other.loader_), meta_object_(other.meta_object_)
+    {
+      other.loader_ = nullptr;
+      other.meta_object_ = nullptr;
+    }
+
+    Factory & operator=(Factory other)
+    {
+      std::swap(loader_, other.loader_);
+      std::swap(meta_object_, other.meta_object_);
+      return *this;
+    }
+
+    ~Factory()
+    {
+      if (nullptr != loader_) {
+        loader_->releasePluginReference();
+      }
+    }
+
+    /**
+     * @brief Indicates if the handle is bound to a factory, i.e. it was not default constructed or moved from
+     */
+    bool valid() const {return nullptr != meta_object_;}
+
+    /**
+     * @brief Gets the name of the class this handle creates instances of
+     */
+    std::string className() const
+    {
+      assert(valid());
+      return meta_object_->className();
+    }
+
+    /**
+     * @brief Generates an instance of the class, see ClassLoader::createSharedInstance()
+     */
+    std::shared_ptr<Base> createShared() const
+    {
+      assert(valid());
+      if (meta_object_->hasClassOperatorNew()) {
+        // The object cannot share its allocation with the control block
+        return std::shared_ptr<Base>(createRaw(), PluginDeleter<Base>(loader_));
+      }
+      loader_->acquirePluginReference();
+      return meta_object_->createShared(PluginReleaser(loader_));
+    }
+
+    /**
+     * @brief Generates an instance of the class, see ClassLoader::createUniqueInstance()
+     */
+    UniquePtr<Base> createUnique() const
+    {
+      return UniquePtr<Base>(createRaw(), PluginDeleter<Base>(loader_));
+    }
+
+    /**
+     * @brief Generates an instance of the class that is destroyed in the background, see ClassLoader::createDeferredInstance()
+     */
+    DeferredPtr<Base> createDeferred() const
+    {
+      return DeferredPtr<Base>(createRaw(), DeferredDeleter<Base>(loader_));
+    }
+
+    /**
+     * @brief Generates count instances of the class in one contiguous allocation, see ClassLoader::createInstances()
+     */
+    InstanceArray<Base> createInstances(std::size_t count) const
+    {
+      assert(valid());
+      InstanceArray<Base> instances;
+      if (0 == count) {
+        return instances;
+      }
+
+      const std::size_t stride = meta_object_->objectSize();
+      const std::size_t alignment = meta_object_->objectAlignment();
+      if (count > (std::numeric_limits<std::size_t>::max() - alignment) / stride) {
+        throw std::bad_array_new_length();
+      }
+      std::size_t space = stride * count + alignment - 1;
+      instances.storage_ = ::operator new(space);
+      loader_->acquirePluginReference();
+      instances.loader_ = loader_;
+      instances.stride_ = stride;
+
+      void * storage = instances.storage_;
+      char * first = static_cast<char *>(std::align(alignment, stride * count, storage, space));
+      // If a constructor throws, the array destroys the instances constructed so far
+      for (; instances.size_ < count; ++instances.size_) {
+        Base * obj = meta_object_->createAt(first + stride * instances.size_);
+        if (0 == instances.size_) {
+          instances.first_ = obj;
+        }
+      }
+      return instances;
+    }
+
+    /**
+     * @brief Gets the size in bytes of an instance of the class, i.e. how much storage createInPlace() needs at least
+     */
+    std::size_t objectSize() const
+    {
+      assert(valid());
+      return meta_object_->objectSize();
+    }
+
+    /**
+     * @brief Gets the alignment required by an instance of the class
+     */
+    std::size_t objectAlignment() const
+    {
+      assert(valid());
+      return meta_object_->objectAlignment();
+    }
+
+    /**
+     * @brief Constructs an instance of the class in storage provided by the caller, see ClassLoader::createInPlace()
+     */
+    InPlacePtr<Base> createInPlace(void * buffer, std::size_t size) const
+    {
+      assert(valid());
+      void * storage = buffer;
+      if (nullptr == std::align(objectAlignment(), objectSize(), storage, size)) {
+        throw class_loader::CreateClassException(
+                "Buffer is too small to create instance of type " + className() + " in place");
+      }
+      Base * obj = meta_object_->createAt(storage);
+      loader_->acquirePluginReference();
+      return InPlacePtr<Base>(loader_, obj);
+    }
+
+    /**
+     * @brief Generates an instance of the class recycled through the instance pool, see ClassLoader::createPooledInstance()
+     */
+    PooledPtr<Base> createPooled() const
+    {
+      assert(valid());
+      if (meta_object_->hasClassOperatorNew()) {
+        return PooledPtr<Base>(createRaw(), PooledDeleter<Base>(loader_, meta_object_, nullptr));
+      }
+      const std::size_t size = meta_object_->objectSize();
+      const std::size_t alignment = meta_object_->objectAlignment();
+      impl::InstancePool & pool = meta_object_->getInstancePool();
+      impl::InstancePool::Block block;
+      Base * obj = nullptr;
+      if (!pool.acquire(block)) {
+        block.storage = ::operator new(size + alignment - 1);
+        block.object = nullptr;
+      }
+      if (nullptr != block.object) {
+        obj = static_cast<Base *>(block.object);
+      } else {
+        void * storage = block.storage;
+        std::size_t space = size + alignment - 1;
+        try {
+          obj = meta_object_->createAt(std::align(alignment, size, storage, space));
+        } catch (...) {
+          pool.release(block);
+          throw;
+        }
+      }
+      loader_->acquirePluginReference();
+      return PooledPtr<Base>(obj, PooledDeleter<Base>(loader_, meta_object_, block.storage));
+    }
+
+    /**
+     * @brief Gets the hit/miss counters of the instance pool used by createPooled()
+     */
+    impl::InstancePool::Statistics getPoolStatistics() const
+    {
+      assert(valid());
+      return meta_object_->getInstancePool().getStatistics();
+    }
+
+private:
+    friend class ClassLoader;
+
+    /**
+     * @brief Takes over a plugin reference the ClassLoader acquired on behalf of the handle
+     */
+    Factory(ClassLoader * loader, impl::AbstractMetaObject<Base> * meta_object)
+    : loader_(loader), meta_object_(meta_object) {}
+
+    Base * createRaw() const
+    {
+      assert(valid());
+      Base * obj = meta_object_->create();
+      loader_->acquirePluginReference();
+      return obj;
+    }
+
+    ClassLoader * loader_;
+    impl::AbstractMetaObject<Base> * meta_object_;
+  };
 
   /**
    * @brief  Constructor for ClassLoader
@@ -114,6 +622,12 @@ public:
   CLASS_LOADER_PUBLIC
   std::string getLibraryPath() {return library_path_;}
 
+  /**
+   * @brief Gets the path the library is tracked by internally, resolved once when this class loader was constructed (@see impl::getCanonicalLibraryPath())
+   */
+  CLASS_LOADER_PUBLIC
+  const std::string & getCanonicalLibraryPath() const {return canonical_library_path_;}
+
   /**
    * @brief  Generates an instance of loadable classes (i.e. class_loader).
    *
@@ -126,9 +640,9 @@ public:
   template<class Base>
   std::shared_ptr<Base> createSharedInstance(const std::string & derived_class_name)
   {
-    return std::shared_ptr<Base>(
-      createRawInstance<Base>(derived_class_name, true),
-      boost::bind(&ClassLoader::onPluginDeletion<Base>, this, _1));
+    // The object and the shared_ptr control block are created in a single allocation, unless the
+    // class declares its own operator new
+    return getFactory<Base>(derived_class_name).createShared();
   }
 
   /**
@@ -140,8 +654,7 @@ public:
   boost::shared_ptr<Base> createInstance(const std::string & derived_class_name)
   {
     return boost::shared_ptr<Base>(
-      createRawInstance<Base>(derived_class_name, true),
-      boost::bind(&ClassLoader::onPluginDeletion<Base>, this, _1));
+      createRawInstance<Base>(derived_class_name, true), PluginDeleter<Base>(this));
   }
 
   /**
@@ -160,9 +673,7 @@ public:
   UniquePtr<Base> createUniqueInstance(const std::string & derived_class_name)
   {
     Base * raw = createRawInstance<Base>(derived_class_name, true);
-    return std::unique_ptr<Base, DeleterType<Base>>(
-      raw,
-      boost::bind(&ClassLoader::onPluginDeletion<Base>, this, _1));
+    return UniquePtr<Base>(raw, PluginDeleter<Base>(this));
   }
 
   /**
@@ -183,6 +694,114 @@ public:
     return createRawInstance<Base>(derived_class_name, false);
   }
 
+  /**
+   * @brief  Generates an instance of loadable classes (i.e. class_loader) whose destruction is deferred to a background thread.
+   *
+   * Destroying the returned pointer only queues the object. A reclamation thread shared by all ClassLoaders runs its destructor later and then releases it from this ClassLoader, which in on-demand mode also unloads the library there if it was the last plugin object. This keeps expensive destructors (freeing large buffers, joining threads) off latency critical threads. The destructor of this ClassLoader waits for its queued objects.
+   *
+   * It is not necessary for the user to call loadLibrary() as it will be invoked automatically
+   * if the library is not yet loaded (which typically happens when in "On Demand Load/Unload" mode).
+   *
+   * @param  derived_class_name The name of the class we want to create (@see getAvailableClasses())
+   * @return A DeferredPtr<Base> to the newly created plugin object
+   */
+  template<class Base>
+  DeferredPtr<Base> createDeferredInstance(const std::string & derived_class_name)
+  {
+    Base * raw = createRawInstance<Base>(derived_class_name, true);
+    return DeferredPtr<Base>(raw, DeferredDeleter<Base>(this));
+  }
+
+  /**
+   * @brief Gets the queue depth and latency counters of the reclamation thread that destroys deferred instances, @see createDeferredInstance()
+   */
+  CLASS_LOADER_PUBLIC
+  static DeferredDestructionStatistics getDeferredDestructionStatistics();
+
+  /**
+   * @brief  Generates a batch of instances of a loadable class, constructed next to each other in a single allocation.
+   *
+   * The allocation is made by class_loader, so an operator new declared by the class itself is not used for the batch.
+   *
+   * It is not necessary for the user to call loadLibrary() as it will be invoked automatically
+   * if the library is not yet loaded (which typically happens when in "On Demand Load/Unload" mode).
+   *
+   * @param  derived_class_name The name of the class we want to create (@see getAvailableClasses())
+   * @param  count The number of instances to create
+   * @return An InstanceArray<Base> owning the newly created plugin objects
+   */
+  template<class Base>
+  InstanceArray<Base> createInstances(const std::string & derived_class_name, std::size_t count)
+  {
+    return getFactory<Base>(derived_class_name).createInstances(count);
+  }
+
+  /**
+   * @brief  Generates an instance of loadable classes (i.e. class_loader), recycling the memory of previously released instances of the same class.
+   *
+   * Every MetaObject keeps a pool of the blocks of released pooled instances: a new pooled instance reuses one of them when available instead of going through operator new. If the class declares a `void resetForReuse()` member, released instances are not even destroyed but reset and handed out again as they are. The pool is emptied when the library is unloaded. Instances of a class that declares its own operator new are not pooled, but allocated and freed like those of createUniqueInstance().
+   *
+   * It is not necessary for the user to call loadLibrary() as it will be invoked automatically
+   * if the library is not yet loaded (which typically happens when in "On Demand Load/Unload" mode).
+   *
+   * @param  derived_class_name The name of the class we want to create (@see getAvailableClasses())
+   * @return A PooledPtr<Base> to the plugin object
+   */
+  template<class Base>
+  PooledPtr<Base> createPooledInstance(const std::string & derived_class_name)
+  {
+    return getFactory<Base>(derived_class_name).createPooled();
+  }
+
+  /**
+   * @brief  Constructs an instance of loadable classes (i.e. class_loader) in storage provided by the caller, such as a member buffer or an arena, without allocating any memory.
+   *
+   * The object is placed at the first address within buffer that is suitably aligned for it, even if its class declares its own operator new. Use getFactory() to query how much storage a class needs (Factory::objectSize() and Factory::objectAlignment()) and to avoid repeating the class lookup.
+   *
+   * It is not necessary for the user to call loadLibrary() as it will be invoked automatically
+   * if the library is not yet loaded (which typically happens when in "On Demand Load/Unload" mode).
+   *
+   * @param  derived_class_name The name of the class we want to create (@see getAvailableClasses())
+   * @param  buffer The storage to construct the object in
+   * @param  size The size of buffer in bytes
+   * @return A non-owning InPlacePtr<Base> to the plugin object, which must be destroyed explicitly with InPlacePtr::destroy()
+   * @throws class_loader::CreateClassException if the class is not available or the buffer is too small
+   */
+  template<class Base>
+  InPlacePtr<Base> createInPlace(
+    const std::string & derived_class_name, void * buffer, std::size_t size)
+  {
+    return getFactory<Base>(derived_class_name).createInPlace(buffer, size);
+  }
+
+  /**
+   * @brief  Resolves the factory of a loadable class once, so that many instances of it can be created without repeating the lookup.
+   *
+   * It is not necessary for the user to call loadLibrary() as it will be invoked automatically
+   * if the library is not yet loaded (which typically happens when in "On Demand Load/Unload" mode).
+   * The library then stays loaded for as long as the returned handle exists.
+   *
+   * @param  derived_class_name The name of the class we want to create (@see getAvailableClasses())
+   * @return A handle that creates instances of the class
+   * @throws class_loader::CreateClassException if the class is not available to this ClassLoader
+   */
+  template<class Base>
+  Factory<Base> getFactory(const std::string & derived_class_name)
+  {
+    informIfOnDemandUnloadIsDisabled();
+    // Pin the library before it is loaded so that it cannot be unloaded in between
+    acquirePluginReference();
+    try {
+      loadLibraryIfNotLoaded();
+      class_loader::impl::FactoryRegistryReadGuard registry;
+      return Factory<Base>(
+        this, class_loader::impl::getMetaObjectForClass<Base>(registry, derived_class_name, this));
+    } catch (...) {
+      releasePluginReference();
+      throw;
+    }
+  }
+
   /**
    * @brief Indicates if a plugin class is available
    * @param Base - polymorphic type indicating base class
@@ -192,9 +811,18 @@ public:
   template<class Base>
   bool isClassAvailable(const std::string & class_name)
   {
-    std::vector<std::string> available_classes = getAvailableClasses<Base>();
-    return std::find(
-      available_classes.begin(), available_classes.end(), class_name) != available_classes.end();
+    return class_loader::impl::isClassAvailable<Base>(class_name, this);
+  }
+
+  /**
+   * @brief Calls a function with the name of every class getAvailableClasses() would return, without building a vector of copies of the names
+   * @param Base - polymorphic type indicating base class
+   * @param callback - called as callback(const std::string & class_name) for every class, in no particular order. It must not load or unload libraries.
+   */
+  template<class Base, typename Callback>
+  void forEachAvailableClass(Callback && callback)
+  {
+    class_loader::impl::forEachAvailableClass<Base>(this, std::forward<Callback>(callback));
   }
 
   /**
@@ -225,6 +853,20 @@ public:
   CLASS_LOADER_PUBLIC
   void loadLibrary();
 
+  /**
+   * @brief Loads the library like loadLibraryIfNotLoaded(), but on executor rather than on the calling thread, so the caller never blocks opening it. As nothing is loaded if the library is loaded already, this never takes a load reference that unloadLibrary() would have to drop, and on-demand unloading keeps working. Instances created in the meantime wait for the load in progress (or, if it has not started yet, load the library themselves, which the pending load then finds loaded) instead of opening the library a second time. While a load started this way is still in progress, further calls return its future rather than loading the library again, and the destructor waits for it.
+   * @param executor - Runs the load, see makeThreadLoadExecutor(). If empty, a new thread is started for it. It must run the task eventually, even if it is shut down, as the destructor blocks until it did.
+   * @return A future that becomes ready once the library is loaded, holding the exception if it could not be
+   */
+  CLASS_LOADER_PUBLIC
+  std::shared_future<void> loadLibraryAsync(const LoadExecutor & executor = LoadExecutor());
+
+  /**
+   * @brief Calls loadLibrary() unless the library is already loaded within the scope of this ClassLoader. Checking and loading happen under the same lock, so concurrent on-demand loads only load the library once. As long as no library was loaded or unloaded since the library was last seen loaded, this returns right away without taking the lock or scanning the registry.
+   */
+  CLASS_LOADER_PUBLIC
+  void loadLibraryIfNotLoaded();
+
   /**
    * @brief  Attempts to unload a library loaded within scope of the ClassLoader. If the library is not opened, this method has no effect. If the library is opened by other another ClassLoader, the library will NOT be unloaded internally -- however this ClassLoader will no longer be able to instantiate class_loader bound to that library. If there are plugin objects that exist in memory created by this classloader, a warning message will appear and the library will not be unloaded. If loadLibrary() was called multiple times (e.g. in the case of multiple threads or purposefully in a single thread), the user is responsible for calling unloadLibrary() the same number of times. The library will not be unloaded within the context of this classloader until the number of unload calls matches the number of loads.
    * @return The number of times more unloadLibrary() has to be called for it to be unbound from this ClassLoader
@@ -232,6 +874,65 @@ public:
   CLASS_LOADER_PUBLIC
   int unloadLibrary();
 
+  /**
+   * @brief Unloads the library if nothing needs it, without the warning unloadLibrary() gives otherwise. That is the case when it was loaded exactly once and no plugin object (or Factory handle) created by this ClassLoader exists. Unmanaged instances are not tracked, so once one has been created anywhere in the process this never unloads.
+   * @return true if the library was unloaded
+   */
+  CLASS_LOADER_PUBLIC
+  bool unloadLibraryIfUnused();
+
+  /**
+   * @struct UnloadStatistics
+   * @brief What the unload grace period (@see setUnloadGracePeriod()) and asynchronous unloading (@see setAsynchronousUnload()) did
+   */
+  struct UnloadStatistics
+  {
+    /// Plugin objects created while only the grace period or a pending asynchronous unload kept the library loaded, each of which would otherwise have loaded it again
+    std::size_t reloads_avoided;
+    /// Times the library was unloaded in the background, because the grace period expired or asynchronous unloading is enabled
+    std::size_t idle_unloads;
+    /// Times the background unload queue was full, so the library was unloaded on the thread that destroyed the last plugin object after all
+    std::size_t queue_full_unloads;
+  };
+
+  /**
+   * @brief Sets how long a library loaded on demand stays loaded after its last plugin object is destroyed. Creating a plugin object in that time reuses the loaded library instead of unloading it and loading it again (which also reruns its static initializers). A background thread unloads the library once it has been idle for the whole period. Only has an effect in on-demand mode.
+   * @param grace_period - How long to keep the idle library loaded, zero (the default) to unload it right away
+   */
+  CLASS_LOADER_PUBLIC
+  void setUnloadGracePeriod(std::chrono::milliseconds grace_period);
+
+  /**
+   * @brief Gets how long a library loaded on demand stays loaded once idle, @see setUnloadGracePeriod()
+   */
+  CLASS_LOADER_PUBLIC
+  std::chrono::milliseconds getUnloadGracePeriod() const;
+
+  /**
+   * @brief Makes destroying the last plugin object hand unloading the library (dlclose, static destructors and purging the factory registry) to a background thread instead of doing it on the destroying thread, which then only queues it. Creating a plugin object before the unload ran keeps the library loaded. Only has an effect in on-demand mode.
+   * @param enabled - true to unload in the background, false (the default) to unload right away. An unload grace period is always waited out in the background.
+   */
+  CLASS_LOADER_PUBLIC
+  void setAsynchronousUnload(bool enabled);
+
+  /**
+   * @brief Indicates if libraries are unloaded in the background, @see setAsynchronousUnload()
+   */
+  CLASS_LOADER_PUBLIC
+  bool isAsynchronousUnloadEnabled() const;
+
+  /**
+   * @brief Bounds the number of ClassLoaders whose unload can wait for the background thread at the same time (256 by default). Once that many are waiting, the thread that destroys the last plugin object unloads the library itself, like it does without asynchronous unloading.
+   */
+  CLASS_LOADER_PUBLIC
+  static void setUnloadQueueCapacity(std::size_t capacity);
+
+  /**
+   * @brief Gets the counters of the unload grace period and asynchronous unloading, @see setUnloadGracePeriod() and setAsynchronousUnload()
+   */
+  CLASS_LOADER_PUBLIC
+  UnloadStatistics getUnloadStatistics() const;
+
 private:
   /**
    * @brief Callback method when a plugin created by this class loader is destroyed
@@ -246,24 +947,55 @@ private:
     if (nullptr == obj) {
       return;
     }
-    boost::recursive_mutex::scoped_lock lock(plugin_ref_count_mutex_);
+    // No lock is held while the object is destroyed
     delete (obj);
-    plugin_ref_count_ = plugin_ref_count_ - 1;
-    assert(plugin_ref_count_ >= 0);
-    if (0 == plugin_ref_count_ && isOnDemandLoadUnloadEnabled()) {
-      if (!ClassLoader::hasUnmanagedInstanceBeenCreated()) {
-        unloadLibraryInternal(false);
-      } else {
-        CONSOLE_BRIDGE_logWarn(
-          "class_loader::ClassLoader: "
-          "Cannot unload library %s even though last shared pointer went out of scope. "
-          "This is because createUnmanagedInstance was used within the scope of this process,"
-          " perhaps by a different ClassLoader. Library will NOT be closed.",
-          getLibraryPath().c_str());
-      }
-    }
+    releasePluginReference();
+  }
+
+  /**
+   * @brief Destroys a deferred plugin object on the reclamation thread, @see DeferredDeleter
+   */
+  template<typename Base>
+  static void reclaimDeferredInstance(ClassLoader * loader, void * obj)
+  {
+    loader->onPluginDeletion<Base>(static_cast<Base *>(obj));
   }
 
+  /**
+   * @brief Queues obj to the reclamation thread, which calls reclaim(this, obj)
+   */
+  CLASS_LOADER_PUBLIC
+  void queueDeferredDestruction(void (* reclaim)(ClassLoader *, void *), void * obj);
+
+  /**
+   * @class PluginReleaser
+   * @brief Releases the plugin reference of an instance whose destruction is not done by onPluginDeletion()
+   */
+  class PluginReleaser
+  {
+public:
+    explicit PluginReleaser(ClassLoader * loader)
+    : loader_(loader) {}
+
+    void operator()() const {loader_->releasePluginReference();}
+
+private:
+    ClassLoader * loader_;
+  };
+
+  /**
+   * @brief Registers one more live managed plugin object (or Factory handle), which keeps the library loaded. Waits if the library is being unloaded.
+   * @throws class_loader::CreateClassException if the calling thread is the one unloading the library, e.g. from a static destructor of the library
+   */
+  CLASS_LOADER_PUBLIC
+  void acquirePluginReference();
+
+  /**
+   * @brief Unregisters a live managed plugin object (or Factory handle). When the last one goes away in on-demand mode the library is unloaded: the reference count is atomically switched from one to PLUGIN_REF_COUNT_UNLOADING, so no other thread can take a new reference (and expect the library to stay loaded) until the unload is done.
+   */
+  CLASS_LOADER_PUBLIC
+  void releasePluginReference();
+
   /**
    * @brief  Generates an instance of loadable classes (i.e. class_loader).
    *
@@ -278,37 +1010,36 @@ private:
   Base * createRawInstance(const std::string & derived_class_name, bool managed)
   {
     if (!managed) {
-      has_unmananged_instance_been_created_ = true;
+      has_unmananged_instance_been_created_.store(true);
     }
 
-    if (
-      managed &&
-      ClassLoader::hasUnmanagedInstanceBeenCreated() &&
-      isOnDemandLoadUnloadEnabled())
-    {
-      CONSOLE_BRIDGE_logInform("%s",
-        "class_loader::ClassLoader: "
-        "An attempt is being made to create a managed plugin instance (i.e. boost::shared_ptr), "
-        "however an unmanaged instance was created within this process address space. "
-        "This means libraries for the managed instances will not be shutdown automatically on "
-        "final plugin destruction if on demand (lazy) loading/unloading mode is used."
-      );
-    }
-    if (!isLibraryLoaded()) {
-      loadLibrary();
+    if (managed) {
+      informIfOnDemandUnloadIsDisabled();
+      // Take the reference before the library is loaded so that it cannot be unloaded in between
+      acquirePluginReference();
     }
 
-    Base * obj = class_loader::impl::createInstance<Base>(derived_class_name, this);
-    assert(obj != nullptr);  // Unreachable assertion if createInstance() throws on failure
-
-    if (managed) {
-      boost::recursive_mutex::scoped_lock lock(plugin_ref_count_mutex_);
-      ++plugin_ref_count_;
+    Base * obj = nullptr;
+    try {
+      loadLibraryIfNotLoaded();
+      obj = class_loader::impl::createInstance<Base>(derived_class_name, this);
+    } catch (...) {
+      if (managed) {
+        releasePluginReference();
+      }
+      throw;
     }
+    assert(obj != nullptr);  // Unreachable assertion if createInstance() throws on failure
 
     return obj;
   }
 
+  /**
+   * @brief Informs the user that managed plugin instances will not unload the library when they go away, which is the case in on-demand mode once an unmanaged instance has been created
+   */
+  CLASS_LOADER_PUBLIC
+  void informIfOnDemandUnloadIsDisabled();
+
   /**
   * @brief Getter for if an unmanaged (i.e. unsafe) instance has been created flag
   */
@@ -316,23 +1047,62 @@ private:
   static bool hasUnmanagedInstanceBeenCreated();
 
   /**
-   * @brief As the library may be unloaded in "on-demand load/unload" mode, unload maybe called from createInstance(). The problem is that createInstance() locks the plugin_ref_count as does unloadLibrary(). This method is the implementation of unloadLibrary but with a parameter to decide if plugin_ref_mutex_ should be locked
-   * @param lock_plugin_ref_count - Set to true if plugin_ref_count_mutex_ should be locked, else false
+   * @brief As the library may be unloaded in "on-demand load/unload" mode, unload maybe called when the last plugin object is destroyed. In that case the plugin reference count has already been handed over to unloading (@see releasePluginReference()), whereas unloadLibrary() still has to claim it. This method is the implementation of unloadLibrary but with a parameter to decide if the plugin reference count should be claimed
+   * @param claim_plugin_ref_count - Set to true if the plugin reference count should be switched from zero to PLUGIN_REF_COUNT_UNLOADING (the library is not unloaded if plugin objects still exist), false if the caller already did so
    * @return The number of times unloadLibraryInternal has to be called again for it to be unbound from this ClassLoader
    */
   CLASS_LOADER_PUBLIC
-  int unloadLibraryInternal(bool lock_plugin_ref_count);
+  int unloadLibraryInternal(bool claim_plugin_ref_count);
+
+  /**
+   * @brief Unloads the library once the unload grace period expired or asynchronous unloading got to it, unless a plugin object was created in the meantime. Called on the background unloader thread, or on the releasing thread if its queue is full.
+   * @return true if the library was unloaded
+   */
+  bool unloadIdleLibrary();
+
+  /**
+   * @brief Blocks until the library is not being unloaded any more, i.e. until plugin_ref_count_ leaves PLUGIN_REF_COUNT_UNLOADING
+   */
+  void waitWhileUnloading();
+
+  /**
+   * @brief Releases the plugin reference count claimed for unloading and wakes up the threads waiting in waitWhileUnloading()
+   */
+  void finishUnloading();
+
+  /**
+   * @brief The value plugin_ref_count_ holds while the library may be in the process of being unloaded
+   */
+  static const int PLUGIN_REF_COUNT_UNLOADING = -1;
 
 private:
   bool ondemand_load_unload_;
   std::string library_path_;
+  std::string canonical_library_path_;
   int load_ref_count_;
   boost::recursive_mutex load_ref_count_mutex_;
-  int plugin_ref_count_;
-  boost::recursive_mutex plugin_ref_count_mutex_;
+  /// Notified with load_ref_count_mutex_ when plugin_ref_count_ leaves PLUGIN_REF_COUNT_UNLOADING
+  boost::condition_variable_any unload_finished_condition_;
+  std::atomic<int> plugin_ref_count_;
+  std::atomic<std::chrono::milliseconds::rep> unload_grace_period_ms_;
+  std::atomic<bool> asynchronous_unload_;
+  /// Set while only the unload grace period or a queued asynchronous unload keeps the library
+  /// loaded
+  std::atomic<bool> idle_unload_pending_;
+  std::atomic<std::size_t> reloads_avoided_;
+  std::atomic<std::size_t> idle_unloads_;
+  std::atomic<std::size_t> queue_full_unloads_;
+  /// Set once an object of this ClassLoader was queued for deferred destruction
+  std::atomic<bool> has_deferred_instances_;
+  /// The library generation (@see impl::getLibraryGeneration()) the library was last seen loaded
+  /// at, 0 if never
+  std::atomic<std::uint64_t> loaded_generation_;
+  /// The load started by loadLibraryAsync(), which the destructor waits for
+  boost::mutex async_load_mutex_;
+  std::shared_future<void> async_load_;
 
   CLASS_LOADER_PUBLIC
-  static bool has_unmananged_instance_been_created_;
+  static std::atomic<bool> has_unmananged_instance_been_created_;
 };
 
 }  // namespace class_loader
@@ -33,16 +33,21 @@
 #define CLASS_LOADER__CLASS_LOADER_CORE_HPP_
 
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/utility/string_view.hpp>
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
-#include <map>
+#include <memory>
 #include <string>
 #include <typeinfo>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "class_loader/exceptions.hpp"
 #include "class_loader/meta_object.hpp"
+#include "class_loader/string_hash_map.hpp"
 #include "class_loader/visibility_control.hpp"
 
 // forward declaration
@@ -67,16 +72,58 @@ namespace impl
 typedef std::string LibraryPath;
 typedef std::string ClassName;
 typedef std::string BaseClassName;
-typedef std::map<ClassName, impl::AbstractMetaObjectBase *> FactoryMap;
-typedef std::map<BaseClassName, FactoryMap> BaseToFactoryMapMap;
-typedef std::pair<LibraryPath, Poco::SharedLibrary *> LibraryPair;
-typedef std::vector<LibraryPair> LibraryVector;
+typedef StringHashMap<impl::AbstractMetaObjectBase *> FactoryMap;
+typedef StringHashMap<FactoryMap> BaseToFactoryMapMap;
+typedef StringHashMap<Poco::SharedLibrary *> LibraryMap;
 typedef std::vector<AbstractMetaObjectBase *> MetaObjectVector;
+typedef std::unordered_set<const ClassLoader *> ClassLoaderSet;
+
+/**
+ * @brief A factory as seen by lock free readers: the MetaObject together with the ClassLoaders that owned its library when the snapshot it belongs to was published. The owners are shared by all factories of the library.
+ */
+struct FactorySnapshotEntry
+{
+  FactorySnapshotEntry()
+  : meta_object(nullptr) {}
+
+  bool isOwnedBy(const ClassLoader * loader) const
+  {
+    return owners != nullptr && owners->count(loader) > 0;
+  }
+
+  AbstractMetaObjectBase * meta_object;
+  std::shared_ptr<const ClassLoaderSet> owners;
+};
+typedef StringHashMap<FactorySnapshotEntry> FactoryMapSnapshot;
+/// The FactoryMap snapshots of base classes that did not change are shared with the previous snapshot
+typedef StringHashMap<std::shared_ptr<const FactoryMapSnapshot>> BaseToFactoryMapMapSnapshot;
+
+/**
+ * @struct GraveyardStatistics
+ * @brief Describes the graveyard, which keeps the MetaObjects of closed libraries that may still be in memory so that they can be revived when the library is opened again
+ */
+struct GraveyardStatistics
+{
+  /// Libraries with MetaObjects in the graveyard
+  std::size_t libraries;
+  /// MetaObjects in the graveyard
+  std::size_t meta_objects;
+  /// Approximate memory held by the graveyard and its MetaObjects
+  std::size_t bytes;
+  /// MetaObjects destroyed because the library they belong to had left memory when it was closed
+  std::size_t reclaimed;
+};
 
 // Debug
 CLASS_LOADER_PUBLIC
 void printDebugInfoToScreen();
 
+/**
+ * @brief Gets the size of the graveyard, @see GraveyardStatistics
+ */
+CLASS_LOADER_PUBLIC
+GraveyardStatistics getGraveyardStatistics();
+
 // Global storage
 
 /**
@@ -87,21 +134,29 @@ CLASS_LOADER_PUBLIC
 BaseToFactoryMapMap & getGlobalPluginBaseToFactoryMapMap();
 
 /**
- * @brief Gets a handle to a list of open libraries in the form of LibraryPairs which encode the library path+name and the handle to the underlying Poco::SharedLibrary
- * @return A reference to the global vector that tracks loaded libraries
+ * @brief Gets a handle to the table of open libraries, which maps the canonical path of each library (@see getCanonicalLibraryPath()) to the handle to the underlying Poco::SharedLibrary
+ * @return A reference to the global table that tracks loaded libraries
  */
 CLASS_LOADER_PUBLIC
-LibraryVector & getLoadedLibraryVector();
+LibraryMap & getLoadedLibraryMap();
 
 /**
- * @brief When a library is being loaded, in order for factories to know which library they are being associated with, they use this function to query which library is being loaded.
+ * @brief Gets the name a library is tracked by. Paths naming the same file (relative ones, ones going through symbolic links) map to its real path, and while a library is in memory other paths to its file (hard links) map to the path it was loaded by, so the library is opened once and its MetaObjects are shared. Names without a directory, which the dynamic linker searches for, are tracked as they are. Resolutions of absolute paths are cached as long as the path still names the same file, but this still checks the file every time: ClassLoader resolves its library path once and keeps the result.
+ * @param library_path - The path the library was requested by
+ * @return The canonical path of the library
+ */
+CLASS_LOADER_PUBLIC
+std::string getCanonicalLibraryPath(const std::string & library_path);
+
+/**
+ * @brief When a library is being loaded, in order for factories to know which library they are being associated with, they use this function to query which library is being loaded. The value is per thread, as static initializers run on the thread that opens the library.
  * @return The currently set loading library name as a string
  */
 CLASS_LOADER_PUBLIC
 std::string getCurrentlyLoadingLibraryName();
 
 /**
- * @brief When a library is being loaded, in order for factories to know which library they are being associated with, this function is called to set the name of the library currently being loaded.
+ * @brief When a library is being loaded, in order for factories to know which library they are being associated with, this function is called to set the name of the library the calling thread is currently loading.
  * @param library_name - The name of library that is being loaded currently
  */
 CLASS_LOADER_PUBLIC
@@ -109,14 +164,14 @@ void setCurrentlyLoadingLibraryName(const std::string & library_name);
 
 
 /**
- * @brief Gets the ClassLoader currently in scope which used when a library is being loaded.
+ * @brief Gets the ClassLoader currently in scope which used when a library is being loaded by the calling thread.
  * @return A pointer to the currently active ClassLoader.
  */
 CLASS_LOADER_PUBLIC
 ClassLoader * getCurrentlyActiveClassLoader();
 
 /**
- * @brief Sets the ClassLoader currently in scope which used when a library is being loaded.
+ * @brief Sets the ClassLoader currently in scope which used when a library is being loaded by the calling thread.
  * @param loader - pointer to the currently active ClassLoader.
  */
 CLASS_LOADER_PUBLIC
@@ -125,10 +180,11 @@ void setCurrentlyActiveClassLoader(ClassLoader * loader);
 
 /**
  * @brief This function extracts a reference to the FactoryMap for appropriate base class out of the global plugin base to factory map. This function should be used by functions in this namespace that need to access the various factories so as to make sure the right key is generated to index into the global map.
+ * @param typeid_base_class_name - The typeid(Base).name() of the base class, looked up without copying it into a std::string
  * @return A reference to the FactoryMap contained within the global Base-to-FactoryMap map.
  */
 CLASS_LOADER_PUBLIC
-FactoryMap & getFactoryMapForBaseClass(const std::string & typeid_base_class_name);
+FactoryMap & getFactoryMapForBaseClass(boost::string_view typeid_base_class_name);
 
 /**
  * @brief Same as above but uses a type parameter instead of string for more safety if info is available.
@@ -145,10 +201,72 @@ FactoryMap & getFactoryMapForBaseClass()
  * @return A reference to the global mutex
  */
 CLASS_LOADER_PUBLIC
-boost::recursive_mutex & getLoadedLibraryVectorMutex();
+boost::recursive_mutex & getLoadedLibraryMapMutex();
 CLASS_LOADER_PUBLIC
 boost::recursive_mutex & getPluginBaseToFactoryMapMapMutex();
 
+/**
+ * @brief Publishes an immutable snapshot of the global factory map map (including the owners of every MetaObject) for FactoryRegistryReadGuard. Writers call this after they are done modifying the map; the previous snapshot is reclaimed once no reader can still be using it.
+ */
+CLASS_LOADER_PUBLIC
+void publishFactoryRegistrySnapshot();
+
+/**
+ * @brief Publishes a snapshot like publishFactoryRegistrySnapshot(), unless a FactoryRegistryPublishBatch is alive on the calling thread, in which case the published snapshot is only marked as stale. It is then replaced when the last batch of the thread ends, or earlier by the first FactoryRegistryReadGuard that needs it or by a write on another thread.
+ */
+CLASS_LOADER_PUBLIC
+void requestFactoryRegistrySnapshot();
+
+/**
+ * @class FactoryRegistryPublishBatch
+ * @brief Coalesces the snapshots library loads on the calling thread publish while it is alive into a single one, published when the last batch of the thread ends. Loading many libraries otherwise publishes once per library. Loads on other threads are not held back by the batch.
+ */
+class CLASS_LOADER_PUBLIC FactoryRegistryPublishBatch
+{
+public:
+  FactoryRegistryPublishBatch();
+  ~FactoryRegistryPublishBatch();
+
+private:
+  FactoryRegistryPublishBatch(const FactoryRegistryPublishBatch &);
+  FactoryRegistryPublishBatch & operator=(const FactoryRegistryPublishBatch &);
+};
+
+/**
+ * @class FactoryRegistryReadGuard
+ * @brief Gives lock free, read-only access to the most recently published snapshot of the global factory map map.
+ *
+ * Snapshots are swapped atomically by writers and reclaimed with epoch based reclamation: the snapshot (and any MetaObject retired after it was taken) stays valid for as long as the guard is alive, so everything read through the guard must be used before it is destroyed. Guards may be nested. If the factory map map was modified but the change has not been published yet, the guard publishes it first so readers never see stale data; only that first reader after a batch of writes takes the mutex. Leaving the outermost guard reclaims the objects retired meanwhile, unless another thread holds the mutex at that moment.
+ */
+class CLASS_LOADER_PUBLIC FactoryRegistryReadGuard
+{
+public:
+  FactoryRegistryReadGuard();
+  ~FactoryRegistryReadGuard();
+
+  /**
+   * @brief Gets the snapshot of the FactoryMap for a base class
+   * @param typeid_base_class_name - The typeid(Base).name() of the base class
+   * @return The FactoryMap snapshot, nullptr if no factory has ever been registered for that base class
+   */
+  const FactoryMapSnapshot * getFactoryMapForBaseClass(
+    boost::string_view typeid_base_class_name) const;
+
+  /**
+   * @brief Finds the factory for a class
+   * @return The snapshot entry of the factory, nullptr if the class is not registered
+   */
+  const FactorySnapshotEntry * findFactory(
+    boost::string_view typeid_base_class_name, boost::string_view class_name) const;
+
+private:
+  FactoryRegistryReadGuard(const FactoryRegistryReadGuard &);
+  FactoryRegistryReadGuard & operator=(const FactoryRegistryReadGuard &);
+
+  void * reader_;
+  const BaseToFactoryMapMapSnapshot * snapshot_;
+};
+
 /**
  * @brief Indicates if a library containing more than just plugins has been opened by the running process
  * @return True if a non-pure plugin library has been opened, otherwise false
@@ -163,6 +281,20 @@ bool hasANonPurePluginLibraryBeenOpened();
 CLASS_LOADER_PUBLIC
 void hasANonPurePluginLibraryBeenOpened(bool hasIt);
 
+/**
+ * @brief Adds a MetaObject that has just been inserted into the global factory map map to the per-library and per-ClassLoader indexes, which let library and ClassLoader queries avoid scanning every registered MetaObject. The MetaObject's library path and owners must already be set. This also marks the published snapshot of the factory map map as out of date.
+ * @param meta_obj - The MetaObject to index
+ */
+CLASS_LOADER_PUBLIC
+void addMetaObjectToIndexes(AbstractMetaObjectBase * meta_obj);
+
+/**
+ * @brief Removes a MetaObject that is being taken out of the global factory map map from the per-library and per-ClassLoader indexes. Has no effect if the MetaObject is not indexed.
+ * @param meta_obj - The MetaObject to remove
+ */
+CLASS_LOADER_PUBLIC
+void removeMetaObjectFromIndexes(AbstractMetaObjectBase * meta_obj);
+
 // Plugin Functions
 
 /**
@@ -181,7 +313,7 @@ void registerPlugin(const std::string & class_name, const std::string & base_cla
   CONSOLE_BRIDGE_logDebug(
     "class_loader.impl: "
     "Registering plugin factory for class = %s, ClassLoader* = %p and library name %s.",
-    class_name.c_str(), getCurrentlyActiveClassLoader(),
+    class_name.c_str(), reinterpret_cast<void *>(getCurrentlyActiveClassLoader()),
     getCurrentlyLoadingLibraryName().c_str());
 
   if (nullptr == getCurrentlyActiveClassLoader()) {
@@ -207,14 +339,16 @@ void registerPlugin(const std::string & class_name, const std::string & base_cla
   // Create factory
   impl::AbstractMetaObject<Base> * new_factory =
     new impl::MetaObject<Derived, Base>(class_name, base_class_name);
-  new_factory->addOwningClassLoader(getCurrentlyActiveClassLoader());
+  // Ownership belongs to the library, so its path has to be known first
   new_factory->setAssociatedLibraryPath(getCurrentlyLoadingLibraryName());
+  new_factory->addOwningClassLoader(getCurrentlyActiveClassLoader());
 
 
   // Add it to global factory map map
   getPluginBaseToFactoryMapMapMutex().lock();
   FactoryMap & factoryMap = getFactoryMapForBaseClass<Base>();
-  if (factoryMap.find(class_name) != factoryMap.end()) {
+  AbstractMetaObjectBase * & factory_slot = factoryMap[class_name];
+  if (factory_slot != nullptr) {
     CONSOLE_BRIDGE_logWarn(
       "class_loader.impl: SEVERE WARNING!!! "
       "A namespace collision has occurred with plugin factory for class %s. "
@@ -224,8 +358,13 @@ void registerPlugin(const std::string & class_name, const std::string & base_cla
       "Please separate plugins out into their own library or just don't link against the library "
       "and use either class_loader::ClassLoader/MultiLibraryClassLoader to open.",
       class_name.c_str());
+    removeMetaObjectFromIndexes(factory_slot);
   }
-  factoryMap[class_name] = new_factory;
+  factory_slot = new_factory;
+  addMetaObjectToIndexes(new_factory);
+  // The snapshot is only marked as stale: loadLibrary() publishes it once the whole library has
+  // registered, and registrations outside of a load (plugins linked into the executable) are
+  // published by the next reader, so that registering N plugins copies the registry once.
   getPluginBaseToFactoryMapMapMutex().unlock();
 
   CONSOLE_BRIDGE_logDebug(
@@ -235,51 +374,63 @@ void registerPlugin(const std::string & class_name, const std::string & base_cla
 }
 
 /**
- * @brief This function creates an instance of a plugin class given the derived name of the class and returns a pointer of the Base class type.
+ * @brief Resolves the factory that a ClassLoader creates instances of a class with: the one owned by that ClassLoader or, failing that, one with no owner at all (which happens when the library was dlopen()ed by means other than the class_loader interface).
+ * @param registry - The read guard the factory is looked up through. The factory may only be used while the guard is alive, unless its library is kept loaded by other means.
  * @param derived_class_name - The name of the derived class (unmangled)
  * @param loader - The ClassLoader whose scope we are within
- * @return A pointer to newly created plugin, note caller is responsible for object destruction
+ * @return The factory, never nullptr
+ * @throws class_loader::CreateClassException if no such factory is visible to loader
  */
 template<typename Base>
-Base * createInstance(const std::string & derived_class_name, ClassLoader * loader)
+AbstractMetaObject<Base> * getMetaObjectForClass(
+  const FactoryRegistryReadGuard & registry, const std::string & derived_class_name,
+  ClassLoader * loader)
 {
+  const FactorySnapshotEntry * entry =
+    registry.findFactory(typeid(Base).name(), derived_class_name);
   AbstractMetaObject<Base> * factory = nullptr;
-
-  getPluginBaseToFactoryMapMapMutex().lock();
-  FactoryMap & factoryMap = getFactoryMapForBaseClass<Base>();
-  if (factoryMap.find(derived_class_name) != factoryMap.end()) {
-    factory = dynamic_cast<impl::AbstractMetaObject<Base> *>(factoryMap[derived_class_name]);
+  if (entry != nullptr) {
+    factory = dynamic_cast<impl::AbstractMetaObject<Base> *>(entry->meta_object);
   } else {
     CONSOLE_BRIDGE_logError(
       "class_loader.impl: No metaobject exists for class type %s.", derived_class_name.c_str());
   }
-  getPluginBaseToFactoryMapMapMutex().unlock();
 
-  Base * obj = nullptr;
-  if (factory != nullptr && factory->isOwnedBy(loader)) {
-    obj = factory->create();
+  if (factory != nullptr && entry->isOwnedBy(loader)) {
+    return factory;
   }
 
-  if (nullptr == obj) {  // Was never created
-    if (factory && factory->isOwnedBy(nullptr)) {
-      CONSOLE_BRIDGE_logDebug("%s",
-        "class_loader.impl: ALERT!!! "
-        "A metaobject (i.e. factory) exists for desired class, but has no owner. "
-        "This implies that the library containing the class was dlopen()ed by means other than "
-        "through the class_loader interface. "
-        "This can happen if you build plugin libraries that contain more than just plugins "
-        "(i.e. normal code your app links against) -- that intrinsically will trigger a dlopen() "
-        "prior to main(). "
-        "You should isolate your plugins into their own library, otherwise it will not be "
-        "possible to shutdown the library!");
-
-      obj = factory->create();
-    } else {
-      throw class_loader::CreateClassException(
-              "Could not create instance of type " + derived_class_name);
-    }
+  if (factory && entry->isOwnedBy(nullptr)) {
+    CONSOLE_BRIDGE_logDebug("%s",
+      "class_loader.impl: ALERT!!! "
+      "A metaobject (i.e. factory) exists for desired class, but has no owner. "
+      "This implies that the library containing the class was dlopen()ed by means other than "
+      "through the class_loader interface. "
+      "This can happen if you build plugin libraries that contain more than just plugins "
+      "(i.e. normal code your app links against) -- that intrinsically will trigger a dlopen() "
+      "prior to main(). "
+      "You should isolate your plugins into their own library, otherwise it will not be "
+      "possible to shutdown the library!");
+    return factory;
   }
 
+  throw class_loader::CreateClassException(
+          "Could not create instance of type " + derived_class_name);
+}
+
+/**
+ * @brief This function creates an instance of a plugin class given the derived name of the class and returns a pointer of the Base class type.
+ * @param derived_class_name - The name of the derived class (unmangled)
+ * @param loader - The ClassLoader whose scope we are within
+ * @return A pointer to newly created plugin, note caller is responsible for object destruction
+ */
+template<typename Base>
+Base * createInstance(const std::string & derived_class_name, ClassLoader * loader)
+{
+  // The guard keeps the factory alive while it is being used, no lock is taken
+  FactoryRegistryReadGuard registry;
+  Base * obj = getMetaObjectForClass<Base>(registry, derived_class_name, loader)->create();
+
   CONSOLE_BRIDGE_logDebug(
     "class_loader.impl: Created instance of type %s and object pointer = %p",
     (typeid(obj).name()), reinterpret_cast<void *>(obj));
@@ -295,17 +446,20 @@ Base * createInstance(const std::string & derived_class_name, ClassLoader * load
 template<typename Base>
 std::vector<std::string> getAvailableClasses(ClassLoader * loader)
 {
-  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
-
-  FactoryMap & factory_map = getFactoryMapForBaseClass<Base>();
+  FactoryRegistryReadGuard registry;
   std::vector<std::string> classes;
   std::vector<std::string> classes_with_no_owner;
 
-  for (auto & it : factory_map) {
-    AbstractMetaObjectBase * factory = it.second;
-    if (factory->isOwnedBy(loader)) {
+  const FactoryMapSnapshot * factory_map = registry.getFactoryMapForBaseClass(typeid(Base).name());
+  if (nullptr == factory_map) {
+    return classes;
+  }
+
+  for (auto & it : *factory_map) {
+    const FactorySnapshotEntry & factory = it.second;
+    if (factory.isOwnedBy(loader)) {
       classes.push_back(it.first);
-    } else if (factory->isOwnedBy(nullptr)) {
+    } else if (factory.isOwnedBy(nullptr)) {
       classes_with_no_owner.push_back(it.first);
     }
   }
@@ -316,6 +470,74 @@ std::vector<std::string> getAvailableClasses(ClassLoader * loader)
   return classes;
 }
 
+/**
+ * @brief Indicates if a class is one of the classes getAvailableClasses() would return, by probing the registry directly instead of listing every class.
+ * @param class_name - The name of the class
+ * @param loader - The pointer to the ClassLoader whose scope we are within
+ * @return true if the class can be created within the scope of loader, false otherwise
+ */
+template<typename Base>
+bool isClassAvailable(boost::string_view class_name, const ClassLoader * loader)
+{
+  FactoryRegistryReadGuard registry;
+  const FactorySnapshotEntry * entry = registry.findFactory(typeid(Base).name(), class_name);
+  return entry != nullptr && (entry->isOwnedBy(loader) || entry->isOwnedBy(nullptr));
+}
+
+/**
+ * @brief Calls a function with the name of every class getAvailableClasses() would return, in no particular order, without copying the names.
+ * @param loader - The pointer to the ClassLoader whose scope we are within
+ * @param callback - Called as callback(const std::string & class_name). The reference is only valid during the call. The callback may create instances but must not load or unload libraries.
+ */
+template<typename Base, typename Callback>
+void forEachAvailableClass(const ClassLoader * loader, Callback && callback)
+{
+  FactoryRegistryReadGuard registry;
+  const FactoryMapSnapshot * factory_map = registry.getFactoryMapForBaseClass(typeid(Base).name());
+  if (nullptr == factory_map) {
+    return;
+  }
+
+  for (auto & it : *factory_map) {
+    if (it.second.isOwnedBy(loader) || it.second.isOwnedBy(nullptr)) {
+      callback(it.first);
+    }
+  }
+}
+
+/**
+ * @brief Binds a ClassLoader to a library, which puts all factories of the library within its scope. Ownership is tracked per library rather than per factory, so this is a single hash set insertion however many classes the library has.
+ * @param library_path - The canonical path of the library
+ * @param loader - The ClassLoader to bind, nullptr for factories registered outside of a load
+ */
+CLASS_LOADER_PUBLIC
+void attachClassLoaderToLibrary(const std::string & library_path, ClassLoader * loader);
+
+/**
+ * @brief Unbinds a ClassLoader from a library, @see attachClassLoaderToLibrary()
+ * @return true if the ClassLoader was bound to the library, false otherwise
+ */
+CLASS_LOADER_PUBLIC
+bool detachClassLoaderFromLibrary(const std::string & library_path, const ClassLoader * loader);
+
+/**
+ * @brief Indicates if a ClassLoader is bound to a library, @see attachClassLoaderToLibrary()
+ */
+CLASS_LOADER_PUBLIC
+bool isLibraryOwnedBy(const std::string & library_path, const ClassLoader * loader);
+
+/**
+ * @brief Indicates if any ClassLoader is bound to a library, @see attachClassLoaderToLibrary()
+ */
+CLASS_LOADER_PUBLIC
+bool isLibraryOwnedByAnybody(const std::string & library_path);
+
+/**
+ * @brief Gets the ClassLoaders bound to a library, in no particular order
+ */
+CLASS_LOADER_PUBLIC
+ClassLoaderVector getLibraryOwners(const std::string & library_path);
+
 /**
  * @brief This function returns the names of all libraries in use by a given class loader.
  * @param loader - The ClassLoader whose scope we are within
@@ -324,6 +546,15 @@ std::vector<std::string> getAvailableClasses(ClassLoader * loader)
 CLASS_LOADER_PUBLIC
 std::vector<std::string> getAllLibrariesUsedByClassLoader(const ClassLoader * loader);
 
+/**
+ * @brief Gets the classes whose factories are owned by a ClassLoader, for every base class
+ * @param loader - The ClassLoader whose scope we are within
+ * @return Pairs of the typeid name of the base class and the name of the class
+ */
+CLASS_LOADER_PUBLIC
+std::vector<std::pair<std::string, std::string>> getOwnedClassesOfAllBases(
+  const ClassLoader * loader);
+
 /**
  * @brief Indicates if passed library loaded within scope of a ClassLoader. The library maybe loaded in memory, but to the class loader it may not be.
  * @param library_path - The name of the library we wish to check is open
@@ -333,6 +564,14 @@ std::vector<std::string> getAllLibrariesUsedByClassLoader(const ClassLoader * lo
 CLASS_LOADER_PUBLIC
 bool isLibraryLoaded(const std::string & library_path, ClassLoader * loader);
 
+/**
+ * @brief Same as isLibraryLoaded(), but takes the canonical path of the library so it is not resolved again
+ * @param library_path - The canonical path of the library (@see getCanonicalLibraryPath())
+ * @param loader - The pointer to the ClassLoader whose scope we are within
+ */
+CLASS_LOADER_PUBLIC
+bool isCanonicalLibraryLoadedBy(const std::string & library_path, ClassLoader * loader);
+
 /**
  * @brief Indicates if passed library has been loaded by ANY ClassLoader
  * @param library_path - The name of the library we wish to check is open
@@ -342,13 +581,28 @@ CLASS_LOADER_PUBLIC
 bool isLibraryLoadedByAnybody(const std::string & library_path);
 
 /**
- * @brief Loads a library into memory if it has not already been done so. Attempting to load an already loaded library has no effect.
+ * @brief Same as isLibraryLoadedByAnybody(), but takes the canonical path of the library so it is not resolved again
+ * @param library_path - The canonical path of the library (@see getCanonicalLibraryPath())
+ */
+CLASS_LOADER_PUBLIC
+bool isCanonicalLibraryLoaded(const std::string & library_path);
+
+/**
+ * @brief Loads a library into memory if it has not already been done so. Attempting to load an already loaded library has no effect. Different libraries can be loaded concurrently; a thread loading a library that another thread is loading waits for that load and shares its outcome, including the exception if it failed.
  * @param library_path - The name of the library to open
  * @param loader - The pointer to the ClassLoader whose scope we are within
  */
 CLASS_LOADER_PUBLIC
 void loadLibrary(const std::string & library_path, ClassLoader * loader);
 
+/**
+ * @brief Same as loadLibrary(), but takes the canonical path of the library so it is not resolved again
+ * @param library_path - The canonical path of the library (@see getCanonicalLibraryPath())
+ * @param loader - The pointer to the ClassLoader whose scope we are within
+ */
+CLASS_LOADER_PUBLIC
+void loadCanonicalLibrary(const std::string & library_path, ClassLoader * loader);
+
 /**
  * @brief Unloads a library if it loaded in memory and cleans up its corresponding class factories. If it is not loaded, the function has no effect
  * @param library_path - The name of the library to open
@@ -357,6 +611,20 @@ void loadLibrary(const std::string & library_path, ClassLoader * loader);
 CLASS_LOADER_PUBLIC
 void unloadLibrary(const std::string & library_path, ClassLoader * loader);
 
+/**
+ * @brief Same as unloadLibrary(), but takes the canonical path of the library so it is not resolved again
+ * @param library_path - The canonical path of the library (@see getCanonicalLibraryPath())
+ * @param loader - The pointer to the ClassLoader whose scope we are within
+ */
+CLASS_LOADER_PUBLIC
+void unloadCanonicalLibrary(const std::string & library_path, ClassLoader * loader);
+
+/**
+ * @brief Gets a counter that changes whenever any ClassLoader loads or unloads a library. An unload changes it both before it starts and once it is done, so what isLibraryLoaded() returned stays true for as long as the counter read before calling it has not changed.
+ */
+CLASS_LOADER_PUBLIC
+std::uint64_t getLibraryGeneration();
+
 }  // namespace impl
 }  // namespace class_loader
 
@@ -0,0 +1,56 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CLASS_LOADER__LOAD_EXECUTOR_HPP_
+#define CLASS_LOADER__LOAD_EXECUTOR_HPP_
+
+#include <functional>
+
+#include "class_loader/visibility_control.hpp"
+
+namespace class_loader
+{
+
+/**
+ * @brief Runs the tasks asynchronous library loads are made of, e.g. by handing them to a thread pool. It is called with the task to run and must not run it on the calling thread unless blocking that thread is acceptable.
+ */
+typedef std::function<void (const std::function<void()> &)> LoadExecutor;
+
+/**
+ * @brief Gets a LoadExecutor that runs every task on a new detached thread
+ * @param low_priority - Whether the threads should run with the lowest CPU and I/O scheduling priority (SCHED_IDLE and the idle I/O class, on Linux only) so that loading does not compete with latency critical threads
+ */
+CLASS_LOADER_PUBLIC
+LoadExecutor makeThreadLoadExecutor(bool low_priority = false);
+
+}  // namespace class_loader
+
+#endif  // CLASS_LOADER__LOAD_EXECUTOR_HPP_
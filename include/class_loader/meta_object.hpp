@@ -35,11 +35,17 @@
 #ifndef CLASS_LOADER__META_OBJECT_HPP_
 #define CLASS_LOADER__META_OBJECT_HPP_
 
+#include <boost/thread/mutex.hpp>
 #include <console_bridge/console.h>
 #include "class_loader/visibility_control.hpp"
 
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <typeinfo>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace class_loader
@@ -52,6 +58,161 @@ namespace impl
 
 typedef std::vector<class_loader::ClassLoader *> ClassLoaderVector;
 
+/**
+ * @brief Detects if a plugin class opts in to having its instances reused by pooled creation (@see ClassLoader::createPooledInstance()). It does so by declaring a `void resetForReuse()` member, which must not throw. When a pooled instance is released, resetForReuse() is called instead of the destructor and the object itself is handed out again, otherwise the object is destroyed and only its storage is reused.
+ */
+template<class C, class = void>
+struct HasResetForReuse : std::false_type {};
+
+template<class C>
+struct HasResetForReuse<C, decltype(std::declval<C &>().resetForReuse(), void())>
+  : std::true_type {};
+
+/**
+ * @brief Detects if a plugin class (or one of its bases) declares its own operator new. Shared and pooled instances of such a class are allocated with it like those of createInstance(), rather than in storage allocated by class_loader, so the class's operator delete only ever gets memory from its operator new.
+ */
+template<class C, class = void>
+struct HasClassOperatorNew : std::false_type {};
+
+template<class C>
+struct HasClassOperatorNew<C, decltype(C::operator new(std::size_t()), void())>
+  : std::true_type {};
+
+/**
+ * @brief The room reserved in front of a shared instance for its std::shared_ptr control block (@see AbstractMetaObject::createShared()). Control blocks holding a pointer, a deleter and an allocator of one pointer each fit with room to spare.
+ */
+const std::size_t SHARED_INSTANCE_CONTROL_BLOCK_SIZE = 8 * sizeof(void *);
+
+/**
+ * @class SharedInstanceAllocator
+ * @brief The allocator a shared instance hands to std::shared_ptr for its control block: it places the control block in the room reserved at the start of the object's block and frees the whole block together with the control block.
+ */
+template<typename T>
+class SharedInstanceAllocator
+{
+public:
+  typedef T value_type;
+
+  explicit SharedInstanceAllocator(void * block)
+  : block_(block) {}
+
+  template<typename U>
+  SharedInstanceAllocator(const SharedInstanceAllocator<U> & other)  // NOLINT(runtime/explicit)
+  : block_(other.block()) {}
+
+  T * allocate(std::size_t n)
+  {
+    if (n * sizeof(T) <= SHARED_INSTANCE_CONTROL_BLOCK_SIZE &&
+      alignof(T) <= alignof(std::max_align_t))
+    {
+      return static_cast<T *>(block_);
+    }
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T * p, std::size_t)
+  {
+    if (static_cast<void *>(p) != block_) {
+      ::operator delete(p);
+    }
+    ::operator delete(block_);
+  }
+
+  void * block() const {return block_;}
+
+  template<typename U>
+  bool operator==(const SharedInstanceAllocator<U> & other) const {return block_ == other.block();}
+  template<typename U>
+  bool operator!=(const SharedInstanceAllocator<U> & other) const {return block_ != other.block();}
+
+private:
+  void * block_;
+};
+
+/**
+ * @class SharedInstanceDeleter
+ * @brief The deleter of a shared instance: destroys the object, whose memory is freed along with the control block by SharedInstanceAllocator, and then calls on_release.
+ */
+template<class B, typename OnRelease>
+class SharedInstanceDeleter
+{
+public:
+  explicit SharedInstanceDeleter(const OnRelease & on_release)
+  : on_release_(on_release) {}
+
+  void operator()(B * obj)
+  {
+    obj->~B();
+    on_release_();
+  }
+
+private:
+  OnRelease on_release_;
+};
+
+/**
+ * @class InstancePool
+ * @brief The free list of a MetaObject, which holds the storage (and possibly the objects, @see HasResetForReuse) of released pooled plugin instances until they are handed out again.
+ */
+class CLASS_LOADER_PUBLIC InstancePool
+{
+public:
+  /**
+   * @brief A block of storage that was allocated for one plugin object
+   */
+  struct Block
+  {
+    /// What ::operator new returned, the object lives at the suitably aligned address within it
+    void * storage;
+    /// The reset object as a pointer to the base class, nullptr if it was destroyed
+    void * object;
+  };
+
+  struct Statistics
+  {
+    /// The number of instances that were created from an idle block
+    size_t hits;
+    /// The number of instances that had to allocate a new block
+    size_t misses;
+    /// The number of blocks currently waiting in the pool
+    size_t idle;
+  };
+
+  InstancePool();
+
+  /**
+   * @brief Frees the storage of all idle blocks. Idle objects must have been destroyed by AbstractMetaObjectBase::trimInstancePool() before.
+   */
+  ~InstancePool();
+
+  /**
+   * @brief Takes an idle block out of the pool, counting a hit if there was one and a miss otherwise
+   * @return true if a block was taken, false if the pool is empty
+   */
+  bool acquire(Block & block);
+
+  /**
+   * @brief Puts the block of a released instance into the pool
+   */
+  void release(const Block & block);
+
+  /**
+   * @brief Takes all idle blocks out of the pool
+   */
+  std::vector<Block> releaseAll();
+
+  Statistics getStatistics();
+
+private:
+  InstancePool(const InstancePool &);
+  InstancePool & operator=(const InstancePool &);
+
+  boost::mutex mutex_;
+  std::vector<Block> idle_;
+  size_t hits_;
+  size_t misses_;
+};
+
 /**
  * @class AbstractMetaObjectBase
  * @brief A base class for MetaObjects that excludes a polymorphic type parameter. Subclasses are class templates though.
@@ -97,13 +258,13 @@ public:
   void setAssociatedLibraryPath(std::string library_path);
 
   /**
-   * @brief Associates a ClassLoader owner with this factory,
+   * @brief Associates a ClassLoader owner with this factory. Ownership is tracked per library, so this binds the ClassLoader to every factory of the associated library (@see impl::attachClassLoaderToLibrary()).
    * @param loader Handle to the owning ClassLoader.
    */
   void addOwningClassLoader(ClassLoader * loader);
 
   /**
-   * @brief Removes a ClassLoader that is an owner of this factory
+   * @brief Removes a ClassLoader that is an owner of this factory, and so of every factory of the associated library
    * @param loader Handle to the owning ClassLoader.
    */
   void removeOwningClassLoader(const ClassLoader * loader);
@@ -120,10 +281,25 @@ public:
   bool isOwnedByAnybody();
 
   /**
-   * A vector of class loaders that own this metaobject
+   * A vector of class loaders that own this metaobject, i.e. its library
    */
   ClassLoaderVector getAssociatedClassLoaders();
 
+  /**
+   * @brief Gets the pool that pooled instances of this factory's class are recycled through
+   */
+  InstancePool & getInstancePool();
+
+  /**
+   * @brief Gets the approximate memory held by this factory itself, not counting the instances it created
+   */
+  std::size_t memoryUsage() const;
+
+  /**
+   * @brief Destroys the idle objects and frees the idle storage of the instance pool. Must be called before the library is unloaded, as destroying the objects runs code of the library.
+   */
+  virtual void trimInstancePool();
+
 protected:
   /**
    * This is needed to make base class polymorphic (i.e. have a vtable)
@@ -131,11 +307,11 @@ protected:
   virtual void dummyMethod() {}
 
 protected:
-  ClassLoaderVector associated_class_loaders_;
   std::string associated_library_path_;
   std::string base_class_name_;
   std::string class_name_;
   std::string typeid_base_class_name_;
+  InstancePool instance_pool_;
 };
 
 /**
@@ -165,6 +341,78 @@ public:
   /// Create a new instance of a class.
   /// Cannot be used for singletons.
 
+  /**
+   * @brief Gets the size in bytes of the objects created by this factory, i.e. sizeof() the derived class.
+   */
+  virtual std::size_t objectSize() const = 0;
+
+  /**
+   * @brief Gets the alignment required by the objects created by this factory, i.e. alignof() the derived class.
+   */
+  virtual std::size_t objectAlignment() const = 0;
+
+  /**
+   * @brief Constructs an object in storage provided by the caller instead of allocating it. The object is destroyed by calling its (virtual) destructor through the returned pointer; freeing the storage is up to the caller.
+   * @param storage At least objectSize() bytes aligned to objectAlignment()
+   * @return A pointer of parametric type B to the newly constructed object, which need not be equal to storage
+   */
+  virtual B * createAt(void * storage) const = 0;
+
+  /**
+   * @brief Indicates if the objects created by this factory have to be allocated by create(), as their class declares its own operator new (@see HasClassOperatorNew). createAt() bypasses it.
+   */
+  virtual bool hasClassOperatorNew() const = 0;
+
+  /**
+   * @brief Creates an object owned by a std::shared_ptr with a single allocation, like std::allocate_shared() does: the object is constructed with createAt() behind room reserved for the control block, which holds a SharedInstanceDeleter and a SharedInstanceAllocator.
+   *
+   * This is deliberately not virtual, so it is instantiated in the code calling it rather than in the plugin library. That way the control block's code remains valid when on_release triggers unloading the library.
+   * @param on_release Called without arguments exactly once: right after the object was destroyed, or when creating it fails
+   * @return A std::shared_ptr of parametric type B to the newly created object
+   */
+  template<typename OnRelease>
+  std::shared_ptr<B> createShared(const OnRelease & on_release) const
+  {
+    const std::size_t size = objectSize();
+    const std::size_t alignment = objectAlignment();
+    std::size_t space = size + alignment - 1;
+    char * block = nullptr;
+    B * obj = nullptr;
+    try {
+      block = static_cast<char *>(::operator new(SHARED_INSTANCE_CONTROL_BLOCK_SIZE + space));
+      void * storage = block + SHARED_INSTANCE_CONTROL_BLOCK_SIZE;
+      obj = createAt(std::align(alignment, size, storage, space));
+    } catch (...) {
+      ::operator delete(block);
+      on_release();
+      throw;
+    }
+    try {
+      return std::shared_ptr<B>(
+        obj, SharedInstanceDeleter<B, OnRelease>(on_release), SharedInstanceAllocator<B>(block));
+    } catch (...) {
+      // std::shared_ptr has already destroyed the object through the deleter
+      ::operator delete(block);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Prepares an object created by this factory for being handed out again by the instance pool, if its class supports that (@see HasResetForReuse)
+   * @return true if the object was reset, false if it has to be destroyed instead
+   */
+  virtual bool resetForReuse(B * obj) const = 0;
+
+  void trimInstancePool()
+  {
+    for (const InstancePool::Block & block : AbstractMetaObjectBase::instance_pool_.releaseAll()) {
+      if (nullptr != block.object) {
+        static_cast<B *>(block.object)->~B();
+      }
+      ::operator delete(block.storage);
+    }
+  }
+
 private:
   AbstractMetaObject();
   AbstractMetaObject(const AbstractMetaObject &);
@@ -197,6 +445,44 @@ public:
   {
     return new C;
   }
+
+  std::size_t objectSize() const
+  {
+    return sizeof(C);
+  }
+
+  std::size_t objectAlignment() const
+  {
+    return alignof(C);
+  }
+
+  B * createAt(void * storage) const
+  {
+    // Global placement new, the class may declare operator new overloads that hide it
+    return ::new (storage) C;
+  }
+
+  bool hasClassOperatorNew() const
+  {
+    return HasClassOperatorNew<C>::value;
+  }
+
+  bool resetForReuse(B * obj) const
+  {
+    return resetForReuse(obj, HasResetForReuse<C>());
+  }
+
+private:
+  bool resetForReuse(B * obj, std::true_type) const
+  {
+    static_cast<C *>(obj)->resetForReuse();
+    return true;
+  }
+
+  bool resetForReuse(B *, std::false_type) const
+  {
+    return false;
+  }
 };
 
 }  // namespace impl
@@ -33,13 +33,22 @@
 #define CLASS_LOADER__MULTI_LIBRARY_CLASS_LOADER_HPP_
 
 #include <boost/thread.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <future>
 #include <map>
 #include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
 #include <vector>
 
 #include "console_bridge/console.h"
 #include "class_loader/class_loader.hpp"
+#include "class_loader/load_executor.hpp"
+#include "class_loader/string_hash_map.hpp"
 #include "class_loader/visibility_control.hpp"
 
 namespace class_loader
@@ -48,10 +57,49 @@ namespace class_loader
 typedef std::string LibraryPath;
 typedef std::map<LibraryPath, class_loader::ClassLoader *> LibraryToClassLoaderMap;
 typedef std::vector<ClassLoader *> ClassLoaderVector;
+typedef impl::StringHashMap<ClassLoader *> ClassToClassLoaderMap;
+typedef impl::StringHashMap<ClassToClassLoaderMap> BaseToClassLoaderIndex;
+
+/**
+ * @struct LibraryLoadResult
+ * @brief The outcome of loading one library through MultiLibraryClassLoader::loadLibraries()
+ */
+struct LibraryLoadResult
+{
+  LibraryPath library_path;
+  bool loaded;
+  /// The message of the exception the load failed with, empty if it succeeded
+  std::string error;
+};
+
+/**
+ * @struct LibraryEvictionStatistics
+ * @brief What the memory budget of a MultiLibraryClassLoader did, @see MultiLibraryClassLoader::setMemoryBudget()
+ */
+struct LibraryEvictionStatistics
+{
+  /// Libraries unloaded to get within the budget or because of memory pressure
+  std::size_t evictions;
+  /// Evicted libraries that were loaded again because an instance was created from them
+  std::size_t reloads;
+  /// Time spent loading evicted libraries again
+  std::chrono::nanoseconds total_reload_time;
+  /// The longest time a single reload took
+  std::chrono::nanoseconds max_reload_time;
+  /// Memory pressure notifications that libraries were evicted for
+  std::size_t memory_pressure_events;
+  /// The size of the segments the loaded libraries mapped when the budget was last enforced
+  std::size_t mapped_bytes;
+};
 
 /**
 * @class MultiLibraryClassLoader
 * @brief A ClassLoader that can bind more than one runtime library
+*
+* It is safe to use from several threads at once. Creating instances and querying classes only
+* take a shared lock and run concurrently; loading and unloading libraries is exclusive. Because
+* instances are created while the shared lock is held, plugin constructors must not use the same
+* MultiLibraryClassLoader.
 */
 class CLASS_LOADER_PUBLIC MultiLibraryClassLoader
 {
@@ -81,7 +129,8 @@ public:
       "class_loader::MultiLibraryClassLoader: "
       "Attempting to create instance of class type %s.",
       class_name.c_str());
-    ClassLoader * loader = getClassLoaderForClass<Base>(class_name);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForClass<Base>(class_name, lock);
     if (nullptr == loader) {
       throw class_loader::CreateClassException(
               "MultiLibraryClassLoader: Could not create object of class type " +
@@ -105,7 +154,8 @@ public:
   std::shared_ptr<Base>
   createSharedInstance(const std::string & class_name, const std::string & library_path)
   {
-    ClassLoader * loader = getClassLoaderForLibrary(library_path);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForLibrary(library_path, lock);
     if (nullptr == loader) {
       throw class_loader::NoClassLoaderExistsException(
               "Could not create instance as there is no ClassLoader in "
@@ -126,7 +176,8 @@ public:
       "class_loader::MultiLibraryClassLoader: "
       "Attempting to create instance of class type %s.",
       class_name.c_str());
-    ClassLoader * loader = getClassLoaderForClass<Base>(class_name);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForClass<Base>(class_name, lock);
     if (nullptr == loader) {
       throw class_loader::CreateClassException(
               "MultiLibraryClassLoader: Could not create object of class type " +
@@ -146,7 +197,8 @@ public:
   boost::shared_ptr<Base>
   createInstance(const std::string & class_name, const std::string & library_path)
   {
-    ClassLoader * loader = getClassLoaderForLibrary(library_path);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForLibrary(library_path, lock);
     if (nullptr == loader) {
       throw class_loader::NoClassLoaderExistsException(
               "Could not create instance as there is no ClassLoader in "
@@ -166,7 +218,8 @@ public:
     CONSOLE_BRIDGE_logDebug(
       "class_loader::MultiLibraryClassLoader: Attempting to create instance of class type %s.",
       class_name.c_str());
-    ClassLoader * loader = getClassLoaderForClass<Base>(class_name);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForClass<Base>(class_name, lock);
     if (nullptr == loader) {
       throw class_loader::CreateClassException(
               "MultiLibraryClassLoader: Could not create object of class type " + class_name +
@@ -185,7 +238,8 @@ public:
   ClassLoader::UniquePtr<Base>
   createUniqueInstance(const std::string & class_name, const std::string & library_path)
   {
-    ClassLoader * loader = getClassLoaderForLibrary(library_path);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForLibrary(library_path, lock);
     if (nullptr == loader) {
       throw class_loader::NoClassLoaderExistsException(
               "Could not create instance as there is no ClassLoader in "
@@ -206,7 +260,8 @@ public:
   template<class Base>
   Base * createUnmanagedInstance(const std::string & class_name)
   {
-    ClassLoader * loader = getClassLoaderForClass<Base>(class_name);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForClass<Base>(class_name, lock);
     if (nullptr == loader) {
       throw class_loader::CreateClassException(
               "MultiLibraryClassLoader: Could not create class of type " + class_name);
@@ -225,7 +280,8 @@ public:
   template<class Base>
   Base * createUnmanagedInstance(const std::string & class_name, const std::string & library_path)
   {
-    ClassLoader * loader = getClassLoaderForLibrary(library_path);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForLibrary(library_path, lock);
     if (nullptr == loader) {
       throw class_loader::NoClassLoaderExistsException(
               "Could not create instance as there is no ClassLoader in MultiLibraryClassLoader "
@@ -236,7 +292,7 @@ public:
   }
 
   /**
-   * @brief Indicates if a class has been loaded and can be instantiated
+   * @brief Indicates if a class has been loaded and can be instantiated. This looks the class up in the same index as creating an instance does, so like that it loads the libraries not loaded yet in on-demand mode, and a class of an evicted library counts as available.
    * @param Base - polymorphic type indicating Base class
    * @param class_name - name of class that is be inquired about
    * @return true if loaded, false otherwise
@@ -244,9 +300,22 @@ public:
   template<class Base>
   bool isClassAvailable(const std::string & class_name)
   {
-    std::vector<std::string> available_classes = getAvailableClasses<Base>();
-    return available_classes.end() != std::find(
-      available_classes.begin(), available_classes.end(), class_name);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_);
+    return nullptr != getClassLoaderForClass<Base>(class_name);
+  }
+
+  /**
+   * @brief Calls a function with the name of every class getAvailableClasses() would return, without building a vector of copies of the names
+   * @param Base - polymorphic type indicating Base class
+   * @param callback - called as callback(const std::string & class_name) for every class. It must not load or unload libraries.
+   */
+  template<class Base, typename Callback>
+  void forEachAvailableClass(Callback && callback)
+  {
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_);
+    for (auto & library : active_class_loaders_) {
+      library.second->forEachAvailableClass<Base>(callback);
+    }
   }
 
   /**
@@ -265,6 +334,7 @@ public:
   std::vector<std::string> getAvailableClasses()
   {
     std::vector<std::string> available_classes;
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_);
     for (auto & loader : getAllAvailableClassLoaders()) {
       std::vector<std::string> loader_classes = loader->getAvailableClasses<Base>();
       available_classes.insert(
@@ -281,7 +351,8 @@ public:
   template<class Base>
   std::vector<std::string> getAvailableClassesForLibrary(const std::string & library_path)
   {
-    ClassLoader * loader = getClassLoaderForLibrary(library_path);
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_, boost::defer_lock);
+    ClassLoader * loader = lockClassLoaderForLibrary(library_path, lock);
     if (nullptr == loader) {
       throw class_loader::NoClassLoaderExistsException(
               "There is no ClassLoader in MultiLibraryClassLoader bound to library " +
@@ -303,12 +374,48 @@ public:
    */
   void loadLibrary(const std::string & library_path);
 
+  /**
+   * @brief Loads several libraries into memory for this class loader, opening them concurrently, also in on-demand mode as that is the only way to tell whether a library can be loaded. Each loading thread publishes the factories of the libraries it loaded to the registry in one go once it is done, and unlike loadLibrary() a library that fails to load does not keep the others from being loaded.
+   * @param library_paths - the fully qualified paths to the runtime libraries
+   * @param parallelism - the number of threads to load with, 0 for one per hardware thread
+   * @return The outcome for each library, in the order of library_paths
+   */
+  std::vector<LibraryLoadResult> loadLibraries(
+    const std::vector<std::string> & library_paths, std::size_t parallelism = 0);
+
+  /**
+   * @brief Loads a library like loadLibrary(), but on executor rather than on the calling thread, so the caller never blocks opening it. Requesting the same library again while it is loading returns the load in progress. Creating an instance that none of the loaded libraries provides, or one from this library, waits for the load in progress rather than failing.
+   * @param library_path - the fully qualified path to the runtime library
+   * @param executor - Runs the load, see makeThreadLoadExecutor(). If empty, a new thread is started for it.
+   * @return A future that becomes ready once the library is loaded, holding the exception if it could not be
+   */
+  std::shared_future<void> loadLibraryAsync(
+    const std::string & library_path, const LoadExecutor & executor = LoadExecutor());
+
   /**
    * @brief Unloads a library for this class loader
    * @param library_path - the fully qualified path to the runtime library
    */
   int unloadLibrary(const std::string & library_path);
 
+  /**
+   * @brief Limits the memory the loaded libraries take up, measured as the size of the segments they map. Whenever a library is loaded, a background thread unloads the least recently used libraries that have no live plugin objects until the rest fit into the budget. An evicted library stays bound to this class loader and is loaded again when an instance is created from it. Until then, like a library not loaded yet in on-demand mode, its classes are not listed by getAvailableClasses().
+   * @param budget_bytes - The budget, 0 (the default) for no limit
+   * @param react_to_memory_pressure - Also evict every library without live plugin objects when the kernel reports memory pressure (Linux pressure stall information, /proc/pressure/memory)
+   */
+  void setMemoryBudget(std::size_t budget_bytes, bool react_to_memory_pressure = false);
+
+  /**
+   * @brief Evicts libraries until the loaded ones fit into the memory budget, like the background thread does after a library is loaded, @see setMemoryBudget()
+   * @return The number of libraries evicted
+   */
+  std::size_t enforceMemoryBudget();
+
+  /**
+   * @brief Gets the counters of the memory budget, @see setMemoryBudget()
+   */
+  LibraryEvictionStatistics getEvictionStatistics();
+
 private:
   /**
    * @brief Indicates if on-demand (lazy) load/unload is enabled so libraries are loaded/unloaded automatically as needed
@@ -319,31 +426,151 @@ private:
    * @brief Gets a handle to the class loader corresponding to a specific runtime library
    * @param library_path - the library from which we want to create the plugin
    * @return A pointer to the ClassLoader*, == nullptr if not found
+   * @note loader_mutex_ must be held, shared or exclusively
    */
   ClassLoader * getClassLoaderForLibrary(const std::string & library_path);
 
+  /**
+   * @brief Locks loader_mutex_ shared and gets the class loader for a library like getClassLoaderForLibrary(), waiting for an asynchronous load of the library in progress if there is no such class loader yet
+   * @param lock - A lock of loader_mutex_ that is not held yet, held on return
+   */
+  ClassLoader * lockClassLoaderForLibrary(
+    const std::string & library_path, boost::shared_lock<boost::shared_mutex> & lock);
+
+  /**
+   * @brief Locks loader_mutex_ shared and gets the class loader for a class like getClassLoaderForClass(), waiting for the asynchronous loads in progress if no loaded library provides the class
+   * @param lock - A lock of loader_mutex_ that is not held yet, held on return
+   */
+  template<typename Base>
+  ClassLoader * lockClassLoaderForClass(
+    const std::string & class_name, boost::shared_lock<boost::shared_mutex> & lock)
+  {
+    for (;; ) {
+      lock.lock();
+      ClassLoader * loader = getClassLoaderForClass<Base>(class_name);
+      if (nullptr != loader) {
+        noteLibraryUse(loader);
+        return loader;
+      }
+      lock.unlock();
+      if (!waitForAsyncLoads()) {
+        lock.lock();
+        return nullptr;
+      }
+    }
+  }
+
+  /**
+   * @brief Binds a ClassLoader for library_path unless one is bound already
+   * @param library_path - the fully qualified path to the runtime library
+   * @param open_now - open the library even in on-demand mode, so that a library that cannot be loaded is reported right away
+   */
+  void bindLibrary(const std::string & library_path, bool open_now);
+
+  /**
+   * @brief Records that an instance is about to be created from loader for the least recently used order, loading its library again if it was evicted
+   * @note loader_mutex_ must be held shared
+   */
+  void noteLibraryUse(ClassLoader * loader);
+
+  /**
+   * @brief Wakes the eviction thread up to enforce the memory budget, if it is running
+   */
+  void requestEviction();
+
+  /**
+   * @brief Unloads the least recently used libraries without live plugin objects until the loaded ones fit into the memory budget, or all of them under memory pressure. Only takes loader_mutex_ shared, so instances are still created meanwhile.
+   * @return The number of libraries evicted
+   */
+  std::size_t evictLibraries(bool under_memory_pressure);
+
+  struct LibraryUsage;
+
+  /**
+   * @brief Unloads the library of loader and remembers its classes for the index, unless it has live plugin objects
+   * @return true if the library was evicted
+   * @note loader_mutex_ must be held shared
+   */
+  bool evictLibrary(ClassLoader * loader, LibraryUsage & usage);
+
+  /**
+   * @brief The body of the eviction thread started by setMemoryBudget()
+   */
+  void runEvictionThread();
+
+  /**
+   * @brief Waits until the asynchronous loads in progress when called are done
+   * @return false if there were none
+   */
+  bool waitForAsyncLoads();
+
   /**
    * @brief Gets a handle to the class loader corresponding to a specific class
    * @param class_name - name of class for which we want to create instance
    * @return A pointer to the ClassLoader*, == nullptr if not found
+   * @note loader_mutex_ must be held shared
    */
   template<typename Base>
   ClassLoader * getClassLoaderForClass(const std::string & class_name)
   {
-    ClassLoaderVector loaders = getAllAvailableClassLoaders();
-    for (ClassLoaderVector::iterator i = loaders.begin(); i != loaders.end(); ++i) {
-      if (!(*i)->isLibraryLoaded()) {
-        (*i)->loadLibrary();
+    {
+      boost::shared_lock<boost::shared_mutex> lock(class_loader_index_mutex_);
+      BaseToClassLoaderIndex::iterator index = class_loader_index_.find(typeid(Base).name());
+      if (index != class_loader_index_.end()) {
+        ClassToClassLoaderMap::iterator itr = index->second.find(class_name);
+        return itr == index->second.end() ? nullptr : itr->second;
       }
-      if ((*i)->isClassAvailable<Base>(class_name)) {
-        return *i;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(class_loader_index_mutex_);
+    BaseToClassLoaderIndex::iterator index = class_loader_index_.find(typeid(Base).name());
+    ClassToClassLoaderMap & classes =
+      index != class_loader_index_.end() ? index->second : indexClassesForBase<Base>();
+    ClassToClassLoaderMap::iterator itr = classes.find(class_name);
+    return itr == classes.end() ? nullptr : itr->second;
+  }
+
+  /**
+   * @brief Fills the class to ClassLoader index for a base class. Like a linear search through the ClassLoaders would, this loads every library that is not loaded yet, and a class provided by several libraries maps to the first of them in library path order. Evicted libraries are not loaded again, the classes they provided when they were evicted are indexed instead.
+   * @return The index of the classes derived from Base
+   * @note loader_mutex_ must be held shared and class_loader_index_mutex_ exclusively
+   */
+  template<typename Base>
+  ClassToClassLoaderMap & indexClassesForBase()
+  {
+    // Only cached once complete, so a library failing to load is tried again next time
+    ClassToClassLoaderMap classes;
+    for (auto & library : active_class_loaders_) {
+      ClassLoader * loader = library.second;
+      auto index_class = [&classes, loader](const std::string & class_name) {
+          ClassLoader * & indexed_loader = classes[class_name];
+          if (nullptr == indexed_loader) {
+            indexed_loader = loader;
+          }
+        };
+      // Keeps the library from being evicted or loaded again meanwhile
+      LibraryUsage & usage = library_usage_.at(loader);
+      boost::mutex::scoped_lock eviction_lock(usage.eviction_mutex);
+      if (usage.evicted.load()) {
+        auto evicted_classes = usage.evicted_classes.find(typeid(Base).name());
+        if (evicted_classes != usage.evicted_classes.end()) {
+          for (auto & class_name : evicted_classes->second) {
+            index_class(class_name);
+          }
+        }
+        continue;
       }
+      loader->loadLibraryIfNotLoaded();
+      loader->forEachAvailableClass<Base>(index_class);
     }
-    return nullptr;
+    ClassToClassLoaderMap & indexed_classes = class_loader_index_[typeid(Base).name()];
+    indexed_classes.swap(classes);
+    return indexed_classes;
   }
 
   /**
    * @brief Gets all class loaders loaded within scope
+   * @note loader_mutex_ must be held, shared or exclusively
    */
   ClassLoaderVector getAllAvailableClassLoaders();
 
@@ -355,7 +582,47 @@ private:
 private:
   bool enable_ondemand_loadunload_;
   LibraryToClassLoaderMap active_class_loaders_;
-  boost::mutex loader_mutex_;
+  /// Shared by everything that reads active_class_loaders_ (including creating instances through
+  /// the ClassLoaders in it), exclusive when a ClassLoader is added or removed
+  boost::shared_mutex loader_mutex_;
+  /// typeid(Base).name() -> class name -> ClassLoader, filled lazily for each base class and
+  /// cleared whenever a library is added or removed
+  BaseToClassLoaderIndex class_loader_index_;
+  /// Guards filling class_loader_index_ while loader_mutex_ is shared. Holding loader_mutex_
+  /// exclusively is enough to clear it.
+  boost::shared_mutex class_loader_index_mutex_;
+  /// The loads started by loadLibraryAsync() that are not done yet
+  std::map<LibraryPath, std::shared_future<void>> async_loads_;
+  boost::mutex async_loads_mutex_;
+
+
+  struct LibraryUsage
+  {
+    LibraryUsage()
+    : last_used(0), evicted(false) {}
+
+    /// steady_clock time of the last use, in nanoseconds since its epoch
+    std::atomic<std::int64_t> last_used;
+    /// Set from the moment the library is being evicted until it is loaded again
+    std::atomic<bool> evicted;
+    /// Held while the library is evicted, loaded again or indexed
+    boost::mutex eviction_mutex;
+    /// typeid(Base).name() -> the classes the library provided when it was evicted
+    std::map<std::string, std::vector<std::string>> evicted_classes;
+  };
+  /// The usage of each ClassLoader in active_class_loaders_, its keys follow loader_mutex_ like
+  /// active_class_loaders_ does
+  std::unordered_map<const ClassLoader *, LibraryUsage> library_usage_;
+  std::atomic<std::size_t> memory_budget_;
+  std::atomic<bool> react_to_memory_pressure_;
+  std::thread eviction_thread_;
+  /// Guards starting and stopping eviction_thread_ and the requests to it
+  boost::mutex eviction_mutex_;
+  boost::condition_variable eviction_condition_;
+  bool eviction_requested_;
+  bool stop_eviction_;
+  LibraryEvictionStatistics eviction_statistics_;
+  boost::mutex eviction_statistics_mutex_;
 };
 
 
@@ -0,0 +1,370 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CLASS_LOADER__STRING_HASH_MAP_HPP_
+#define CLASS_LOADER__STRING_HASH_MAP_HPP_
+
+#include <boost/utility/string_view.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace class_loader
+{
+namespace impl
+{
+
+/**
+ * @brief Hashes a string eight bytes at a time with a multiply-xorshift mix, finished with the
+ * murmur3 finalizer so that the low bits (the ones used to index the table) depend on every byte.
+ */
+inline std::size_t hashString(boost::string_view key)
+{
+  const std::uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+  const char * data = key.data();
+  std::size_t remaining = key.size();
+  std::uint64_t hash = remaining * multiplier;
+  while (remaining >= sizeof(std::uint64_t)) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    hash = (hash ^ word) * multiplier;
+    hash ^= hash >> 32;
+    data += sizeof(word);
+    remaining -= sizeof(word);
+  }
+  std::uint64_t tail = 0;
+  if (remaining > 0) {
+    std::memcpy(&tail, data, remaining);
+  }
+  hash = (hash ^ tail) * multiplier;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return static_cast<std::size_t>(hash);
+}
+
+/**
+ * @class StringHashMap
+ * @brief An open addressing (linear probing) hash table keyed by std::string.
+ *
+ * Lookups take a boost::string_view so they never have to construct a std::string. The probe
+ * array only holds the cached hash and a pointer to the entry, so probing stays within a few
+ * cache lines and a full key comparison only happens on a hash match. Entries are allocated
+ * individually, which keeps references to values stable across rehashing (like std::map and
+ * std::unordered_map). Iterators are invalidated by insertion but not by erase(), which leaves
+ * a tombstone behind.
+ *
+ * Entries expose first/second like std::pair so it can be iterated the same way as a std::map.
+ */
+template<typename T>
+class StringHashMap
+{
+public:
+  struct value_type
+  {
+    value_type(boost::string_view key, std::size_t key_hash)
+    : first(key.data(), key.size()), second(), hash(key_hash) {}
+
+    const std::string first;
+    T second;
+    const std::size_t hash;
+  };
+
+private:
+  struct Slot
+  {
+    Slot()
+    : hash(0), entry(nullptr), tombstone(false) {}
+
+    std::size_t hash;
+    value_type * entry;
+    bool tombstone;
+  };
+  typedef std::vector<Slot> SlotVector;
+
+  template<typename Entry, typename SlotIterator>
+  class IteratorBase
+  {
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Entry value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Entry * pointer;
+    typedef Entry & reference;
+
+    IteratorBase()
+    : current_(), end_() {}
+    IteratorBase(SlotIterator current, SlotIterator end)
+    : current_(current), end_(end)
+    {
+      skipEmptySlots();
+    }
+
+    reference operator*() const {return *current_->entry;}
+    pointer operator->() const {return current_->entry;}
+
+    IteratorBase & operator++()
+    {
+      ++current_;
+      skipEmptySlots();
+      return *this;
+    }
+
+    IteratorBase operator++(int)
+    {
+      IteratorBase copy(*this);
+      ++(*this);
+      return copy;
+    }
+
+    bool operator==(const IteratorBase & other) const {return current_ == other.current_;}
+    bool operator!=(const IteratorBase & other) const {return current_ != other.current_;}
+
+private:
+    friend class StringHashMap;
+
+    void skipEmptySlots()
+    {
+      while (current_ != end_ && nullptr == current_->entry) {
+        ++current_;
+      }
+    }
+
+    SlotIterator current_;
+    SlotIterator end_;
+  };
+
+public:
+  typedef IteratorBase<value_type, typename SlotVector::iterator> iterator;
+  typedef IteratorBase<const value_type, typename SlotVector::const_iterator> const_iterator;
+
+  StringHashMap()
+  : size_(0), tombstones_(0) {}
+
+  StringHashMap(const StringHashMap & other)
+  : size_(0), tombstones_(0)
+  {
+    reserve(other.size());
+    for (const value_type & entry : other) {
+      insertEntry(entry.first, entry.hash) = entry.second;
+    }
+  }
+
+  StringHashMap(StringHashMap && other)
+  : slots_(std::move(other.slots_)), size_(other.size_), tombstones_(other.tombstones_)
+  {
+    other.slots_.clear();
+    other.size_ = 0;
+    other.tombstones_ = 0;
+  }
+
+  StringHashMap & operator=(StringHashMap other)
+  {
+    swap(other);
+    return *this;
+  }
+
+  ~StringHashMap()
+  {
+    clear();
+  }
+
+  void swap(StringHashMap & other)
+  {
+    slots_.swap(other.slots_);
+    std::swap(size_, other.size_);
+    std::swap(tombstones_, other.tombstones_);
+  }
+
+  iterator begin() {return iterator(slots_.begin(), slots_.end());}
+  iterator end() {return iterator(slots_.end(), slots_.end());}
+  const_iterator begin() const {return const_iterator(slots_.begin(), slots_.end());}
+  const_iterator end() const {return const_iterator(slots_.end(), slots_.end());}
+
+  std::size_t size() const {return size_;}
+  bool empty() const {return 0 == size_;}
+
+  iterator find(boost::string_view key)
+  {
+    std::size_t index = findIndex(key, hashString(key));
+    return index == npos() ?
+           end() : iterator(slots_.begin() + static_cast<std::ptrdiff_t>(index), slots_.end());
+  }
+
+  const_iterator find(boost::string_view key) const
+  {
+    std::size_t index = findIndex(key, hashString(key));
+    return index == npos() ?
+           end() : const_iterator(slots_.begin() + static_cast<std::ptrdiff_t>(index), slots_.end());
+  }
+
+  std::size_t count(boost::string_view key) const
+  {
+    return findIndex(key, hashString(key)) == npos() ? 0 : 1;
+  }
+
+  /**
+   * @brief Returns the value associated with key, default constructing it if it does not exist
+   */
+  T & operator[](boost::string_view key)
+  {
+    std::size_t hash = hashString(key);
+    std::size_t index = findIndex(key, hash);
+    if (index != npos()) {
+      return slots_[index].entry->second;
+    }
+    return insertEntry(key, hash);
+  }
+
+  /**
+   * @brief Removes the entry pointed to by itr
+   * @return An iterator to the entry following the removed one
+   */
+  iterator erase(iterator itr)
+  {
+    Slot & slot = *itr.current_;
+    delete slot.entry;
+    slot.entry = nullptr;
+    slot.tombstone = true;
+    --size_;
+    ++tombstones_;
+    ++itr;
+    return itr;
+  }
+
+  std::size_t erase(boost::string_view key)
+  {
+    iterator itr = find(key);
+    if (itr == end()) {
+      return 0;
+    }
+    erase(itr);
+    return 1;
+  }
+
+  void clear()
+  {
+    for (Slot & slot : slots_) {
+      delete slot.entry;
+    }
+    slots_.clear();
+    size_ = 0;
+    tombstones_ = 0;
+  }
+
+  /**
+   * @brief Grows the table so that it can hold count entries without rehashing
+   */
+  void reserve(std::size_t count)
+  {
+    if ((count + tombstones_) * 4 >= slots_.size() * 3) {
+      rehash(count);
+    }
+  }
+
+private:
+  static std::size_t npos() {return static_cast<std::size_t>(-1);}
+
+  std::size_t findIndex(boost::string_view key, std::size_t hash) const
+  {
+    if (slots_.empty()) {
+      return npos();
+    }
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t index = hash & mask; ; index = (index + 1) & mask) {
+      const Slot & slot = slots_[index];
+      if (nullptr == slot.entry) {
+        if (!slot.tombstone) {
+          return npos();
+        }
+      } else if (slot.hash == hash && key == boost::string_view(slot.entry->first)) {
+        return index;
+      }
+    }
+  }
+
+  T & insertEntry(boost::string_view key, std::size_t hash)
+  {
+    if ((size_ + 1 + tombstones_) * 4 >= slots_.size() * 3) {
+      rehash(std::max(size_ + 1, size_ * 2));
+    }
+    const std::size_t mask = slots_.size() - 1;
+    std::size_t index = hash & mask;
+    while (nullptr != slots_[index].entry) {
+      index = (index + 1) & mask;
+    }
+    Slot & slot = slots_[index];
+    if (slot.tombstone) {
+      slot.tombstone = false;
+      --tombstones_;
+    }
+    slot.hash = hash;
+    slot.entry = new value_type(key, hash);
+    ++size_;
+    return slot.entry->second;
+  }
+
+  void rehash(std::size_t count)
+  {
+    std::size_t capacity = 16;
+    while (capacity * 3 <= count * 4) {
+      capacity *= 2;
+    }
+    SlotVector slots(capacity);
+    const std::size_t mask = capacity - 1;
+    for (Slot & slot : slots_) {
+      if (nullptr != slot.entry) {
+        std::size_t index = slot.hash & mask;
+        while (nullptr != slots[index].entry) {
+          index = (index + 1) & mask;
+        }
+        slots[index].hash = slot.hash;
+        slots[index].entry = slot.entry;
+      }
+    }
+    slots_.swap(slots);
+    tombstones_ = 0;
+  }
+
+  SlotVector slots_;
+  std::size_t size_;
+  std::size_t tombstones_;
+};
+
+}  // namespace impl
+}  // namespace class_loader
+
+#endif  // CLASS_LOADER__STRING_HASH_MAP_HPP_
@@ -29,18 +29,330 @@
 
 #include "class_loader/class_loader.hpp"
 
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "Poco/SharedLibrary.h"
 
 namespace class_loader
 {
 
-bool ClassLoader::has_unmananged_instance_been_created_ = false;
+namespace
+{
+
+/**
+ * @class BackgroundUnloader
+ * @brief Runs the unloads of idle libraries (@see ClassLoader::setUnloadGracePeriod() and ClassLoader::setAsynchronousUnload()) on a background thread once their deadline passed
+ */
+class BackgroundUnloader
+{
+public:
+  static BackgroundUnloader & instance()
+  {
+    // Never destroyed, so ClassLoaders with static storage duration can still use it at exit
+    static BackgroundUnloader * reaper = new BackgroundUnloader();
+    return *reaper;
+  }
+
+  /**
+   * @brief Runs unload for owner at deadline, replacing what was scheduled for owner before
+   * @return false if nothing was scheduled as the queue is full
+   */
+  bool schedule(
+    const void * owner, std::chrono::steady_clock::time_point deadline,
+    const std::function<void()> & unload)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (scheduled_.size() >= capacity_ && 0 == scheduled_.count(owner)) {
+      return false;
+    }
+    ScheduledUnload & scheduled = scheduled_[owner];
+    scheduled.deadline = deadline;
+    scheduled.unload = unload;
+    if (!started_) {
+      std::thread(&BackgroundUnloader::run, this).detach();
+      started_ = true;
+    }
+    condition_.notify_all();
+    return true;
+  }
+
+  void setCapacity(std::size_t capacity)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+  }
+
+  /**
+   * @brief Drops what is scheduled for owner, waiting for it to finish if it is running
+   */
+  void cancel(const void * owner)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    scheduled_.erase(owner);
+    while (running_ == owner) {
+      condition_.wait(lock);
+    }
+  }
+
+private:
+  struct ScheduledUnload
+  {
+    std::chrono::steady_clock::time_point deadline;
+    std::function<void()> unload;
+  };
+
+  BackgroundUnloader()
+  : capacity_(256), running_(nullptr), started_(false) {}
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;; ) {
+      if (scheduled_.empty()) {
+        condition_.wait(lock);
+        continue;
+      }
+      auto next = scheduled_.begin();
+      for (auto itr = scheduled_.begin(); itr != scheduled_.end(); ++itr) {
+        if (itr->second.deadline < next->second.deadline) {
+          next = itr;
+        }
+      }
+      if (next->second.deadline > std::chrono::steady_clock::now()) {
+        // A copy, as cancel() may erase the entry while the wait is woken up
+        const std::chrono::steady_clock::time_point deadline = next->second.deadline;
+        condition_.wait_until(lock, deadline);
+        continue;
+      }
+
+      std::function<void()> unload = next->second.unload;
+      running_ = next->first;
+      scheduled_.erase(next);
+      lock.unlock();
+      try {
+        unload();
+      } catch (const std::exception & e) {
+        CONSOLE_BRIDGE_logError(
+          "class_loader.ClassLoader: Failed to unload a library in the background (%s).", e.what());
+      }
+      lock.lock();
+      running_ = nullptr;
+      condition_.notify_all();
+    }
+  }
+
+  // std primitives as the boost ones need boost::chrono for timed waits
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::map<const void *, ScheduledUnload> scheduled_;
+  std::size_t capacity_;
+  const void * running_;
+  bool started_;
+};
+
+/**
+ * @class InstanceReclaimer
+ * @brief Destroys deferred plugin objects (@see ClassLoader::createDeferredInstance()) on a background thread, in the order they were queued
+ */
+class InstanceReclaimer
+{
+public:
+  typedef void (* Reclaim)(ClassLoader *, void *);
+
+  static InstanceReclaimer & instance()
+  {
+    // Never destroyed, like BackgroundUnloader
+    static InstanceReclaimer * reclaimer = new InstanceReclaimer();
+    return *reclaimer;
+  }
+
+  void push(Reclaim reclaim, ClassLoader * loader, void * obj)
+  {
+    QueuedObject queued = {reclaim, loader, obj, std::chrono::steady_clock::now()};
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.push_back(queued);
+    ++queued_;
+    statistics_.max_queue_depth =
+      std::max(statistics_.max_queue_depth, static_cast<std::size_t>(queued_ - reclaimed_));
+    if (!started_) {
+      std::thread(&InstanceReclaimer::run, this).detach();
+      started_ = true;
+    }
+    // The thread only waits once it emptied the queue
+    if (1 == queue_.size()) {
+      queued_condition_.notify_one();
+    }
+  }
+
+  /**
+   * @brief Waits until the objects queued before the call are destroyed
+   */
+  void drain()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (started_ && std::this_thread::get_id() == thread_id_) {
+      // A deferred object destroys a ClassLoader. The objects before it are done already, those
+      // after it may belong to that ClassLoader too and are destroyed right away.
+      batch_.insert(batch_.end(), queue_.begin(), queue_.end());
+      queue_.clear();
+      lock.unlock();
+      reclaimBatch();
+      return;
+    }
+    const std::uint64_t queued = queued_;
+    while (reclaimed_ < queued) {
+      reclaimed_condition_.wait(lock);
+    }
+  }
+
+  ClassLoader::DeferredDestructionStatistics getStatistics()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ClassLoader::DeferredDestructionStatistics statistics = statistics_;
+    statistics.queue_depth = static_cast<std::size_t>(queued_ - reclaimed_);
+    return statistics;
+  }
+
+private:
+  struct QueuedObject
+  {
+    Reclaim reclaim;
+    ClassLoader * loader;
+    void * obj;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  InstanceReclaimer()
+  : queued_(0), reclaimed_(0), started_(false), next_in_batch_(0), batch_statistics_(),
+    statistics_() {}
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    thread_id_ = std::this_thread::get_id();
+    for (;; ) {
+      while (queue_.empty()) {
+        queued_condition_.wait(lock);
+      }
+      // Take everything queued so far, so pushing only contends with the swap
+      batch_.swap(queue_);
+      lock.unlock();
+
+      reclaimBatch();
+
+      lock.lock();
+      reclaimed_ += batch_.size();
+      statistics_.destroyed += batch_.size();
+      statistics_.total_latency += batch_statistics_.total_latency;
+      statistics_.max_latency = std::max(statistics_.max_latency, batch_statistics_.max_latency);
+      statistics_.total_destruction_time += batch_statistics_.total_destruction_time;
+      statistics_.max_destruction_time =
+        std::max(statistics_.max_destruction_time, batch_statistics_.max_destruction_time);
+      batch_.clear();
+      next_in_batch_ = 0;
+      batch_statistics_ = ClassLoader::DeferredDestructionStatistics();
+      reclaimed_condition_.notify_all();
+    }
+  }
+
+  /**
+   * @brief Destroys the objects of the batch not destroyed yet, also when called from drain() while an object of the batch is being destroyed
+   * @note Only called on the reclamation thread
+   */
+  void reclaimBatch()
+  {
+    while (next_in_batch_ < batch_.size()) {
+      // A copy, as destroying the object may append to batch_
+      QueuedObject queued = batch_[next_in_batch_++];
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      try {
+        queued.reclaim(queued.loader, queued.obj);
+      } catch (const std::exception & e) {
+        CONSOLE_BRIDGE_logError(
+          "class_loader.ClassLoader: Failed to release a deferred plugin object (%s).",
+          e.what());
+      }
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      batch_statistics_.total_latency += end - queued.queued;
+      batch_statistics_.max_latency = std::max(
+        batch_statistics_.max_latency,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - queued.queued));
+      batch_statistics_.total_destruction_time += end - start;
+      batch_statistics_.max_destruction_time = std::max(
+        batch_statistics_.max_destruction_time,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start));
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable queued_condition_;
+  std::condition_variable reclaimed_condition_;
+  std::vector<QueuedObject> queue_;
+  std::uint64_t queued_;
+  std::uint64_t reclaimed_;
+  bool started_;
+  std::thread::id thread_id_;
+  /// The objects being destroyed, only touched by the reclamation thread
+  std::vector<QueuedObject> batch_;
+  std::size_t next_in_batch_;
+  ClassLoader::DeferredDestructionStatistics batch_statistics_;
+  ClassLoader::DeferredDestructionStatistics statistics_;
+};
+
+/**
+ * @brief The ClassLoader whose library the calling thread is unloading, if any
+ */
+const ClassLoader * & getThreadUnloadingClassLoader()
+{
+  static thread_local const ClassLoader * loader = nullptr;
+  return loader;
+}
+
+/**
+ * @class ThreadUnloadingScope
+ * @brief Marks the calling thread as unloading the library of a ClassLoader while it is alive
+ */
+class ThreadUnloadingScope
+{
+public:
+  explicit ThreadUnloadingScope(const ClassLoader * loader)
+  : previous_(getThreadUnloadingClassLoader())
+  {
+    getThreadUnloadingClassLoader() = loader;
+  }
+
+  ~ThreadUnloadingScope()
+  {
+    getThreadUnloadingClassLoader() = previous_;
+  }
+
+private:
+  const ClassLoader * previous_;
+};
+
+}  // namespace
+
+std::atomic<bool> ClassLoader::has_unmananged_instance_been_created_(false);
+const int ClassLoader::PLUGIN_REF_COUNT_UNLOADING;
 
 bool ClassLoader::hasUnmanagedInstanceBeenCreated()
 {
-  return ClassLoader::has_unmananged_instance_been_created_;
+  return ClassLoader::has_unmananged_instance_been_created_.load();
 }
 
 std::string systemLibraryPrefix()
@@ -65,13 +377,22 @@ std::string systemLibraryFormat(const std::string & library_name)
 ClassLoader::ClassLoader(const std::string & library_path, bool ondemand_load_unload)
 : ondemand_load_unload_(ondemand_load_unload),
   library_path_(library_path),
+  canonical_library_path_(class_loader::impl::getCanonicalLibraryPath(library_path)),
   load_ref_count_(0),
-  plugin_ref_count_(0)
+  plugin_ref_count_(0),
+  unload_grace_period_ms_(0),
+  asynchronous_unload_(false),
+  idle_unload_pending_(false),
+  reloads_avoided_(0),
+  idle_unloads_(0),
+  queue_full_unloads_(0),
+  has_deferred_instances_(false),
+  loaded_generation_(0)
 {
   CONSOLE_BRIDGE_logDebug(
     "class_loader.ClassLoader: "
     "Constructing new ClassLoader (%p) bound to library %s.",
-    this, library_path.c_str());
+    reinterpret_cast<void *>(this), library_path.c_str());
   if (!isOnDemandLoadUnloadEnabled()) {
     loadLibrary();
   }
@@ -82,24 +403,169 @@ ClassLoader::~ClassLoader()
   CONSOLE_BRIDGE_logDebug("%s",
     "class_loader.ClassLoader: "
     "Destroying class loader, unloading associated library...\n");
+  if (has_deferred_instances_.load()) {
+    InstanceReclaimer::instance().drain();
+  }
+  std::shared_future<void> async_load;
+  {
+    boost::mutex::scoped_lock lock(async_load_mutex_);
+    async_load = async_load_;
+  }
+  if (async_load.valid()) {
+    async_load.wait();
+  }
+  BackgroundUnloader::instance().cancel(this);
   unloadLibrary();  // TODO(mikaelarguedas): while(unloadLibrary() > 0){} ??
 }
 
 bool ClassLoader::isLibraryLoaded()
 {
-  return class_loader::impl::isLibraryLoaded(getLibraryPath(), this);
+  return class_loader::impl::isCanonicalLibraryLoadedBy(canonical_library_path_, this);
 }
 
 bool ClassLoader::isLibraryLoadedByAnyClassloader()
 {
-  return class_loader::impl::isLibraryLoadedByAnybody(getLibraryPath());
+  return class_loader::impl::isCanonicalLibraryLoaded(canonical_library_path_);
 }
 
 void ClassLoader::loadLibrary()
 {
   boost::recursive_mutex::scoped_lock lock(load_ref_count_mutex_);
+  // Only a successful load is counted, so that releasing the plugin reference taken for a create
+  // whose load failed does not try to unload a library that never got loaded
+  class_loader::impl::loadCanonicalLibrary(canonical_library_path_, this);
   load_ref_count_ = load_ref_count_ + 1;
-  class_loader::impl::loadLibrary(getLibraryPath(), this);
+}
+
+std::shared_future<void> ClassLoader::loadLibraryAsync(const LoadExecutor & executor)
+{
+  boost::mutex::scoped_lock lock(async_load_mutex_);
+  if (async_load_.valid() &&
+    std::future_status::ready != async_load_.wait_for(std::chrono::seconds(0)))
+  {
+    return async_load_;
+  }
+
+  std::shared_ptr<std::promise<void>> loaded = std::make_shared<std::promise<void>>();
+  std::shared_future<void> future = loaded->get_future().share();
+  LoadExecutor run = executor ? executor : makeThreadLoadExecutor();
+  // Nothing may touch this object once the promise is satisfied, the destructor only waits for it
+  run([this, loaded]() {
+      try {
+        loadLibraryIfNotLoaded();
+      } catch (...) {
+        loaded->set_exception(std::current_exception());
+        return;
+      }
+      loaded->set_value();
+    });
+  async_load_ = future;
+  return future;
+}
+
+void ClassLoader::informIfOnDemandUnloadIsDisabled()
+{
+  if (ClassLoader::hasUnmanagedInstanceBeenCreated() && isOnDemandLoadUnloadEnabled()) {
+    CONSOLE_BRIDGE_logInform("%s",
+      "class_loader::ClassLoader: "
+      "An attempt is being made to create a managed plugin instance (i.e. boost::shared_ptr), "
+      "however an unmanaged instance was created within this process address space. "
+      "This means libraries for the managed instances will not be shutdown automatically on "
+      "final plugin destruction if on demand (lazy) loading/unloading mode is used."
+    );
+  }
+}
+
+void ClassLoader::acquirePluginReference()
+{
+  int count = plugin_ref_count_.load();
+  for (;;) {
+    if (PLUGIN_REF_COUNT_UNLOADING == count) {
+      if (getThreadUnloadingClassLoader() == this) {
+        // E.g. a static destructor of the library, waiting would never end
+        throw class_loader::CreateClassException(
+                "Cannot create a plugin object while unloading its library " + getLibraryPath());
+      }
+      // Wait for the unload to finish, a new reference may have to load the library again
+      waitWhileUnloading();
+      count = plugin_ref_count_.load();
+    } else if (plugin_ref_count_.compare_exchange_weak(count, count + 1)) {
+      if (0 == count && idle_unload_pending_.exchange(false)) {
+        ++reloads_avoided_;
+      }
+      return;
+    }
+  }
+}
+
+void ClassLoader::releasePluginReference()
+{
+  const bool unload =
+    isOnDemandLoadUnloadEnabled() && !ClassLoader::hasUnmanagedInstanceBeenCreated();
+  const std::chrono::milliseconds grace_period = getUnloadGracePeriod();
+  const bool unload_now =
+    unload && grace_period.count() <= 0 && !isAsynchronousUnloadEnabled();
+  int count = plugin_ref_count_.load();
+  for (;;) {
+    assert(count > 0);
+    // The last reference hands over to unloading instead of dropping to zero
+    int next = (1 == count && unload_now) ? PLUGIN_REF_COUNT_UNLOADING : count - 1;
+    if (plugin_ref_count_.compare_exchange_weak(count, next)) {
+      break;
+    }
+  }
+  if (1 != count || !isOnDemandLoadUnloadEnabled()) {
+    return;
+  }
+
+  if (unload_now) {
+    unloadLibraryInternal(false);
+  } else if (unload) {
+    // Any earlier deadline is pushed back, the library has to be idle for the whole period
+    idle_unload_pending_.store(true);
+    const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::max(grace_period, std::chrono::milliseconds(0));
+    const bool scheduled = BackgroundUnloader::instance().schedule(
+      this, deadline, [this]() {
+        if (unloadIdleLibrary()) {
+          ++idle_unloads_;
+        }
+      });
+    if (!scheduled) {
+      CONSOLE_BRIDGE_logDebug(
+        "class_loader.ClassLoader: The background unload queue is full, unloading %s right away.",
+        getLibraryPath().c_str());
+      if (unloadIdleLibrary()) {
+        ++queue_full_unloads_;
+      }
+    }
+  } else {
+    CONSOLE_BRIDGE_logWarn(
+      "class_loader::ClassLoader: "
+      "Cannot unload library %s even though last shared pointer went out of scope. "
+      "This is because createUnmanagedInstance was used within the scope of this process,"
+      " perhaps by a different ClassLoader. Library will NOT be closed.",
+      getLibraryPath().c_str());
+  }
+}
+
+void ClassLoader::loadLibraryIfNotLoaded()
+{
+  // Nothing was loaded or unloaded since the library was last seen loaded by this ClassLoader
+  if (loaded_generation_.load(std::memory_order_acquire) ==
+    class_loader::impl::getLibraryGeneration())
+  {
+    return;
+  }
+
+  boost::recursive_mutex::scoped_lock lock(load_ref_count_mutex_);
+  if (!isLibraryLoaded()) {
+    loadLibrary();
+  }
+  const std::uint64_t generation = class_loader::impl::getLibraryGeneration();
+  if (isLibraryLoaded()) {
+    loaded_generation_.store(generation, std::memory_order_release);
+  }
 }
 
 int ClassLoader::unloadLibrary()
@@ -107,29 +573,148 @@ int ClassLoader::unloadLibrary()
   return unloadLibraryInternal(true);
 }
 
-int ClassLoader::unloadLibraryInternal(bool lock_plugin_ref_count)
+bool ClassLoader::unloadLibraryIfUnused()
 {
-  boost::recursive_mutex::scoped_lock load_ref_lock(load_ref_count_mutex_);
-  boost::recursive_mutex::scoped_lock plugin_ref_lock;
-  if (lock_plugin_ref_count) {
-    plugin_ref_lock = boost::recursive_mutex::scoped_lock(plugin_ref_count_mutex_);
+  if (ClassLoader::hasUnmanagedInstanceBeenCreated()) {
+    return false;
   }
+  // Held across the claim so that a plugin object created meanwhile waits for the unload
+  boost::recursive_mutex::scoped_lock lock(load_ref_count_mutex_);
+  if (1 != load_ref_count_) {
+    return false;
+  }
+  int count = 0;
+  if (!plugin_ref_count_.compare_exchange_strong(count, PLUGIN_REF_COUNT_UNLOADING)) {
+    return false;
+  }
+  idle_unload_pending_.store(false);
+  return 0 == unloadLibraryInternal(false);
+}
 
-  if (plugin_ref_count_ > 0) {
-    CONSOLE_BRIDGE_logWarn("class_loader.ClassLoader: SEVERE WARNING!!!\n"
-                           "Attempting to unload %s\n"
-                           "while objects created by this library still exist in the heap!\n"
-                           "You should delete your objects before destroying the ClassLoader. "
-                           "The library will NOT be unloaded.", library_path_.c_str());
-  } else {
+void ClassLoader::setUnloadGracePeriod(std::chrono::milliseconds grace_period)
+{
+  unload_grace_period_ms_.store(grace_period.count());
+}
+
+std::chrono::milliseconds ClassLoader::getUnloadGracePeriod() const
+{
+  return std::chrono::milliseconds(unload_grace_period_ms_.load());
+}
+
+void ClassLoader::setAsynchronousUnload(bool enabled)
+{
+  asynchronous_unload_.store(enabled);
+}
+
+bool ClassLoader::isAsynchronousUnloadEnabled() const
+{
+  return asynchronous_unload_.load();
+}
+
+void ClassLoader::setUnloadQueueCapacity(std::size_t capacity)
+{
+  BackgroundUnloader::instance().setCapacity(capacity);
+}
+
+void ClassLoader::queueDeferredDestruction(void (* reclaim)(ClassLoader *, void *), void * obj)
+{
+  if (!has_deferred_instances_.load(std::memory_order_relaxed)) {
+    has_deferred_instances_.store(true);
+  }
+  InstanceReclaimer::instance().push(reclaim, this, obj);
+}
+
+ClassLoader::DeferredDestructionStatistics ClassLoader::getDeferredDestructionStatistics()
+{
+  return InstanceReclaimer::instance().getStatistics();
+}
+
+ClassLoader::UnloadStatistics ClassLoader::getUnloadStatistics() const
+{
+  UnloadStatistics statistics;
+  statistics.reloads_avoided = reloads_avoided_.load();
+  statistics.idle_unloads = idle_unloads_.load();
+  statistics.queue_full_unloads = queue_full_unloads_.load();
+  return statistics;
+}
+
+bool ClassLoader::unloadIdleLibrary()
+{
+  if (!idle_unload_pending_.exchange(false)) {
+    // A plugin object was created in the meantime and took over the library
+    return false;
+  }
+  int count = 0;
+  if (!plugin_ref_count_.compare_exchange_strong(count, PLUGIN_REF_COUNT_UNLOADING)) {
+    // Same, but its creation did not see the pending unload
+    ++reloads_avoided_;
+    return false;
+  }
+  CONSOLE_BRIDGE_logDebug(
+    "class_loader.ClassLoader: Unloading %s as it is idle.", library_path_.c_str());
+  unloadLibraryInternal(false);
+  return true;
+}
+
+int ClassLoader::unloadLibraryInternal(bool claim_plugin_ref_count)
+{
+  if (claim_plugin_ref_count) {
+    int count = 0;
+    while (!plugin_ref_count_.compare_exchange_weak(count, PLUGIN_REF_COUNT_UNLOADING)) {
+      if (count > 0) {
+        CONSOLE_BRIDGE_logWarn("class_loader.ClassLoader: SEVERE WARNING!!!\n"
+                               "Attempting to unload %s\n"
+                               "while objects created by this library still exist in the heap!\n"
+                               "You should delete your objects before destroying the ClassLoader. "
+                               "The library will NOT be unloaded.", library_path_.c_str());
+        boost::recursive_mutex::scoped_lock load_ref_lock(load_ref_count_mutex_);
+        return load_ref_count_;
+      }
+      if (PLUGIN_REF_COUNT_UNLOADING == count) {
+        // The last plugin object is unloading the library on demand right now
+        waitWhileUnloading();
+      }
+      count = 0;
+    }
+    // The library is unloaded for good, not kept loaded by the grace period any more
+    idle_unload_pending_.store(false);
+  }
+
+  int load_ref_count = 0;
+  try {
+    ThreadUnloadingScope unloading(this);
+    boost::recursive_mutex::scoped_lock load_ref_lock(load_ref_count_mutex_);
     load_ref_count_ = load_ref_count_ - 1;
     if (0 == load_ref_count_) {
-      class_loader::impl::unloadLibrary(getLibraryPath(), this);
+      class_loader::impl::unloadCanonicalLibrary(canonical_library_path_, this);
     } else if (load_ref_count_ < 0) {
       load_ref_count_ = 0;
     }
+    load_ref_count = load_ref_count_;
+  } catch (...) {
+    finishUnloading();
+    throw;
+  }
+  finishUnloading();
+  return load_ref_count;
+}
+
+void ClassLoader::waitWhileUnloading()
+{
+  boost::recursive_mutex::scoped_lock lock(load_ref_count_mutex_);
+  while (PLUGIN_REF_COUNT_UNLOADING == plugin_ref_count_.load()) {
+    unload_finished_condition_.wait(lock);
+  }
+}
+
+void ClassLoader::finishUnloading()
+{
+  {
+    // Changed with the mutex held so that a waiting thread cannot miss the notification
+    boost::recursive_mutex::scoped_lock lock(load_ref_count_mutex_);
+    plugin_ref_count_.store(0);
   }
-  return load_ref_count_;
+  unload_finished_condition_.notify_all();
 }
 
 }  // namespace class_loader
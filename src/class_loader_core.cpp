@@ -32,9 +32,31 @@
 
 #include <Poco/SharedLibrary.h>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace class_loader
@@ -45,7 +67,7 @@ namespace impl
 
 // Global data
 
-boost::recursive_mutex & getLoadedLibraryVectorMutex()
+boost::recursive_mutex & getLoadedLibraryMapMutex()
 {
   static boost::recursive_mutex m;
   return m;
@@ -57,38 +79,466 @@ boost::recursive_mutex & getPluginBaseToFactoryMapMapMutex()
   return m;
 }
 
+// Lock free snapshots of the global factory map map
+//
+// Readers announce the epoch they started in through a per-thread record. Writers swap in a new
+// snapshot, then advance the epoch; whatever they replaced is only reclaimed once every reader
+// that is still inside a read section started after that point. Retired objects are protected by
+// getPluginBaseToFactoryMapMapMutex().
+
+struct SnapshotReaderRecord
+{
+  SnapshotReaderRecord()
+  : epoch(0), depth(0), in_use(true), next(nullptr) {}
+
+  std::atomic<uint64_t> epoch;  // 0 while the thread is not reading
+  unsigned int depth;  // Only touched by the owning thread, supports nested guards
+  std::atomic<bool> in_use;
+  SnapshotReaderRecord * next;
+};
+
+struct RetiredObject
+{
+  uint64_t epoch;
+  std::function<void()> reclaim;
+};
+
+std::atomic<SnapshotReaderRecord *> & getSnapshotReaderRecords()
+{
+  static std::atomic<SnapshotReaderRecord *> head(nullptr);
+  return head;
+}
+
+std::atomic<uint64_t> & getSnapshotEpoch()
+{
+  static std::atomic<uint64_t> epoch(1);
+  return epoch;
+}
+
+std::atomic<const BaseToFactoryMapMapSnapshot *> & getCurrentFactoryRegistrySnapshot()
+{
+  static std::atomic<const BaseToFactoryMapMapSnapshot *> snapshot(
+    new BaseToFactoryMapMapSnapshot());
+  return snapshot;
+}
+
+std::atomic<bool> & getFactoryRegistrySnapshotIsStale()
+{
+  static std::atomic<bool> is_stale(false);
+  return is_stale;
+}
+
+/**
+ * @brief The base classes whose FactoryMap changed since the last snapshot was published, protected by getPluginBaseToFactoryMapMapMutex()
+ */
+std::unordered_set<std::string> & getStaleFactoryRegistryBases()
+{
+  static std::unordered_set<std::string> instance;
+  return instance;
+}
+
+std::vector<RetiredObject> & getRetiredObjects()
+{
+  static std::vector<RetiredObject> instance;
+  return instance;
+}
+
+/**
+ * @brief The size of getRetiredObjects(), which readers check without taking the mutex
+ */
+std::atomic<size_t> & getRetiredObjectCount()
+{
+  static std::atomic<size_t> count(0);
+  return count;
+}
+
+SnapshotReaderRecord * acquireSnapshotReaderRecord()
+{
+  std::atomic<SnapshotReaderRecord *> & head = getSnapshotReaderRecords();
+  // Records are never freed, records of threads that exited are recycled
+  for (SnapshotReaderRecord * record = head.load(); record != nullptr; record = record->next) {
+    bool in_use = false;
+    if (!record->in_use.load() && record->in_use.compare_exchange_strong(in_use, true)) {
+      return record;
+    }
+  }
+  SnapshotReaderRecord * record = new SnapshotReaderRecord();
+  record->next = head.load();
+  while (!head.compare_exchange_weak(record->next, record)) {
+  }
+  return record;
+}
+
+struct ThreadSnapshotReader
+{
+  ThreadSnapshotReader()
+  : record(acquireSnapshotReaderRecord()) {}
+  ~ThreadSnapshotReader()
+  {
+    record->in_use.store(false);
+  }
+
+  SnapshotReaderRecord * record;
+};
+
+SnapshotReaderRecord * getThreadSnapshotReaderRecord()
+{
+  static thread_local ThreadSnapshotReader reader;
+  return reader.record;
+}
+
+void reclaimRetiredObjects()
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  std::vector<RetiredObject> & retired = getRetiredObjects();
+  if (retired.empty()) {
+    return;
+  }
+
+  uint64_t oldest_active_epoch = std::numeric_limits<uint64_t>::max();
+  for (SnapshotReaderRecord * record = getSnapshotReaderRecords().load(); record != nullptr;
+    record = record->next)
+  {
+    uint64_t epoch = record->epoch.load();
+    if (epoch != 0 && epoch < oldest_active_epoch) {
+      oldest_active_epoch = epoch;
+    }
+  }
+
+  std::vector<RetiredObject> still_retired;
+  for (auto & object : retired) {
+    if (object.epoch < oldest_active_epoch) {
+      object.reclaim();
+    } else {
+      still_retired.push_back(object);
+    }
+  }
+  retired.swap(still_retired);
+  getRetiredObjectCount().store(retired.size());
+}
+
+/**
+ * @brief Hands an object that readers might still be using over to epoch based reclamation
+ * @param reclaim - Function that destroys the object once no reader can see it anymore
+ */
+void retireObject(const std::function<void()> & reclaim)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  RetiredObject object;
+  object.epoch = getSnapshotEpoch().fetch_add(1);
+  object.reclaim = reclaim;
+  getRetiredObjects().push_back(object);
+  getRetiredObjectCount().store(getRetiredObjects().size());
+  reclaimRetiredObjects();
+}
+
+void markFactoryRegistrySnapshotStale(const std::string & typeid_base_class_name)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  getStaleFactoryRegistryBases().insert(typeid_base_class_name);
+  getFactoryRegistrySnapshotIsStale().store(true);
+}
+
+// Defined along with the library records further down
+std::shared_ptr<const ClassLoaderSet> getPublishedLibraryOwners(const std::string & library_path);
+
+void publishFactoryRegistrySnapshot()
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  std::unordered_set<std::string> & stale_bases = getStaleFactoryRegistryBases();
+  if (stale_bases.empty()) {
+    getFactoryRegistrySnapshotIsStale().store(false);
+    return;
+  }
+
+  // Only the FactoryMaps of the base classes that changed are copied again
+  const BaseToFactoryMapMapSnapshot * previous = getCurrentFactoryRegistrySnapshot().load();
+  BaseToFactoryMapMapSnapshot * snapshot = new BaseToFactoryMapMapSnapshot(*previous);
+  BaseToFactoryMapMap & factory_map_map = getGlobalPluginBaseToFactoryMapMap();
+  for (auto & base_name : stale_bases) {
+    BaseToFactoryMapMap::iterator base = factory_map_map.find(base_name);
+    if (base == factory_map_map.end()) {
+      BaseToFactoryMapMapSnapshot::iterator itr = snapshot->find(base_name);
+      if (itr != snapshot->end()) {
+        snapshot->erase(itr);
+      }
+      continue;
+    }
+    std::shared_ptr<FactoryMapSnapshot> factories = std::make_shared<FactoryMapSnapshot>();
+    factories->reserve(base->second.size());
+    for (auto & factory : base->second) {
+      FactorySnapshotEntry & entry = (*factories)[factory.first];
+      entry.meta_object = factory.second;
+      entry.owners = getPublishedLibraryOwners(factory.second->getAssociatedLibraryPath());
+    }
+    (*snapshot)[base_name] = factories;
+  }
+  stale_bases.clear();
+
+  getCurrentFactoryRegistrySnapshot().store(snapshot);
+  getFactoryRegistrySnapshotIsStale().store(false);
+  // The FactoryMap snapshots that were replaced go along with the previous snapshot
+  retireObject([previous]() {delete previous;});
+}
+
+/**
+ * @brief The number of FactoryRegistryPublishBatch objects alive on the calling thread
+ */
+int & getFactoryRegistryPublishBatchCount()
+{
+  static thread_local int count = 0;
+  return count;
+}
+
+void requestFactoryRegistrySnapshot()
+{
+  // Within a batch the stale base classes are published when the batch ends
+  if (0 == getFactoryRegistryPublishBatchCount()) {
+    publishFactoryRegistrySnapshot();
+  }
+}
+
+FactoryRegistryPublishBatch::FactoryRegistryPublishBatch()
+{
+  ++getFactoryRegistryPublishBatchCount();
+}
+
+FactoryRegistryPublishBatch::~FactoryRegistryPublishBatch()
+{
+  if (0 == --getFactoryRegistryPublishBatchCount() &&
+    getFactoryRegistrySnapshotIsStale().load())
+  {
+    boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+    if (getFactoryRegistrySnapshotIsStale().load()) {
+      publishFactoryRegistrySnapshot();
+    }
+  }
+}
+
+FactoryRegistryReadGuard::FactoryRegistryReadGuard()
+: reader_(getThreadSnapshotReaderRecord()),
+  snapshot_(nullptr)
+{
+  SnapshotReaderRecord * record = static_cast<SnapshotReaderRecord *>(reader_);
+  if (0 == record->depth++) {
+    record->epoch.store(getSnapshotEpoch().load());
+  }
+  if (getFactoryRegistrySnapshotIsStale().load()) {
+    boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+    if (getFactoryRegistrySnapshotIsStale().load()) {
+      publishFactoryRegistrySnapshot();
+    }
+  }
+  snapshot_ = getCurrentFactoryRegistrySnapshot().load();
+}
+
+FactoryRegistryReadGuard::~FactoryRegistryReadGuard()
+{
+  SnapshotReaderRecord * record = static_cast<SnapshotReaderRecord *>(reader_);
+  if (0 == --record->depth) {
+    record->epoch.store(0);
+    // Leaving may be what the objects retired since this reader entered were waiting for. If
+    // another thread holds the mutex they are left to the next reader, so readers never block.
+    if (getRetiredObjectCount().load() > 0) {
+      boost::unique_lock<boost::recursive_mutex> lock(
+        getPluginBaseToFactoryMapMapMutex(), boost::try_to_lock);
+      if (lock.owns_lock()) {
+        reclaimRetiredObjects();
+      }
+    }
+  }
+}
+
+const FactoryMapSnapshot * FactoryRegistryReadGuard::getFactoryMapForBaseClass(
+  boost::string_view typeid_base_class_name) const
+{
+  BaseToFactoryMapMapSnapshot::const_iterator itr = snapshot_->find(typeid_base_class_name);
+  return itr == snapshot_->end() ? nullptr : itr->second.get();
+}
+
+const FactorySnapshotEntry * FactoryRegistryReadGuard::findFactory(
+  boost::string_view typeid_base_class_name, boost::string_view class_name) const
+{
+  const FactoryMapSnapshot * factories = getFactoryMapForBaseClass(typeid_base_class_name);
+  if (nullptr == factories) {
+    return nullptr;
+  }
+  FactoryMapSnapshot::const_iterator itr = factories->find(class_name);
+  return itr == factories->end() ? nullptr : &itr->second;
+}
+
 BaseToFactoryMapMap & getGlobalPluginBaseToFactoryMapMap()
 {
   static BaseToFactoryMapMap instance;
   return instance;
 }
 
-FactoryMap & getFactoryMapForBaseClass(const std::string & typeid_base_class_name)
+FactoryMap & getFactoryMapForBaseClass(boost::string_view typeid_base_class_name)
 {
-  BaseToFactoryMapMap & factoryMapMap = getGlobalPluginBaseToFactoryMapMap();
-  std::string base_class_name = typeid_base_class_name;
-  if (factoryMapMap.find(base_class_name) == factoryMapMap.end()) {
-    factoryMapMap[base_class_name] = FactoryMap();
-  }
+  return getGlobalPluginBaseToFactoryMapMap()[typeid_base_class_name];
+}
 
-  return factoryMapMap[base_class_name];
+LibraryMap & getLoadedLibraryMap()
+{
+  static LibraryMap instance;
+  return instance;
+}
+
+/**
+ * @brief Identifies a library file independently of the path it is reached by
+ */
+typedef std::pair<std::uint64_t, std::uint64_t> LibraryFileId;
+
+/**
+ * @brief What an absolute library path resolved to, valid as long as it still names the same file
+ */
+struct ResolvedLibraryPath
+{
+  std::string canonical_path;
+  LibraryFileId file;
+};
+
+boost::mutex & getLibraryFilesMutex()
+{
+  static boost::mutex mutex;
+  return mutex;
 }
 
-MetaObjectVector & getMetaObjectGraveyard()
+/**
+ * @brief The number of resolved paths getCanonicalLibraryPath() caches at most
+ */
+const std::size_t MAX_RESOLVED_LIBRARY_PATHS = 1024;
+
+/**
+ * @brief Absolute requested path -> what it resolved to. Relative paths are not cached, as they change meaning with the working directory.
+ */
+StringHashMap<ResolvedLibraryPath> & getResolvedLibraryPaths()
 {
-  static MetaObjectVector instance;
+  static StringHashMap<ResolvedLibraryPath> instance;
   return instance;
 }
 
-LibraryVector & getLoadedLibraryVector()
+/**
+ * @brief File -> canonical path of the library loaded from it, kept until the library leaves memory so that a file taking over its (device, inode) pair is not mistaken for it
+ */
+std::map<LibraryFileId, std::string> & getLoadedLibraryFiles()
 {
-  static LibraryVector instance;
+  static std::map<LibraryFileId, std::string> instance;
   return instance;
 }
 
+#ifndef _WIN32
+/**
+ * @brief Gets the file a path names, following symbolic links
+ * @return false if there is no such file
+ */
+bool getLibraryFileId(const std::string & library_path, LibraryFileId & file)
+{
+  struct stat status;
+  if (0 != stat(library_path.c_str(), &status)) {
+    return false;
+  }
+  file = LibraryFileId(
+    static_cast<std::uint64_t>(status.st_dev), static_cast<std::uint64_t>(status.st_ino));
+  return true;
+}
+#endif
+
+std::string getCanonicalLibraryPath(const std::string & library_path)
+{
+#ifndef _WIN32
+  LibraryFileId file;
+  if (std::string::npos == library_path.find('/') || !getLibraryFileId(library_path, file)) {
+    // Left to the search of the dynamic linker, or the file may show up later
+    return library_path;
+  }
+  const bool is_absolute = '/' == library_path[0];
+
+  std::string canonical_path;
+  if (is_absolute) {
+    boost::mutex::scoped_lock lock(getLibraryFilesMutex());
+    StringHashMap<ResolvedLibraryPath> & resolved_paths = getResolvedLibraryPaths();
+    StringHashMap<ResolvedLibraryPath>::iterator itr = resolved_paths.find(library_path);
+    // A symbolic link that was pointed elsewhere or a replaced file are resolved again
+    if (itr != resolved_paths.end() && itr->second.file == file) {
+      canonical_path = itr->second.canonical_path;
+    }
+  }
+  if (canonical_path.empty()) {
+    char * real_path = realpath(library_path.c_str(), nullptr);
+    if (nullptr == real_path) {
+      return library_path;
+    }
+    canonical_path = real_path;
+    free(real_path);
+  }
+
+  boost::mutex::scoped_lock lock(getLibraryFilesMutex());
+  if (is_absolute) {
+    StringHashMap<ResolvedLibraryPath> & resolved_paths = getResolvedLibraryPaths();
+    // Entries of loaded libraries are dropped when they are unloaded, this bounds the rest
+    if (resolved_paths.size() >= MAX_RESOLVED_LIBRARY_PATHS &&
+      0 == resolved_paths.count(library_path))
+    {
+      resolved_paths.clear();
+    }
+    ResolvedLibraryPath & resolved = resolved_paths[library_path];
+    resolved.canonical_path = canonical_path;
+    resolved.file = file;
+  }
+  std::map<LibraryFileId, std::string>::iterator loaded = getLoadedLibraryFiles().find(file);
+  return loaded == getLoadedLibraryFiles().end() ? canonical_path : loaded->second;
+#else
+  return library_path;
+#endif
+}
+
+/**
+ * @brief Makes other paths to the file of a library that was just opened resolve to library_path
+ */
+void rememberLoadedLibraryFile(const std::string & library_path)
+{
+#ifndef _WIN32
+  LibraryFileId file;
+  if (std::string::npos == library_path.find('/') || !getLibraryFileId(library_path, file)) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(getLibraryFilesMutex());
+  getLoadedLibraryFiles().insert(std::make_pair(file, library_path));
+#else
+  (void)library_path;
+#endif
+}
+
+/**
+ * @brief Drops the file of a library that left memory (@see rememberLoadedLibraryFile()) and the cached resolutions to it
+ */
+void forgetLoadedLibraryFile(const std::string & library_path)
+{
+  boost::mutex::scoped_lock lock(getLibraryFilesMutex());
+  std::map<LibraryFileId, std::string> & loaded_files = getLoadedLibraryFiles();
+  for (auto itr = loaded_files.begin(); itr != loaded_files.end(); ) {
+    if (itr->second == library_path) {
+      itr = loaded_files.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+  StringHashMap<ResolvedLibraryPath> & resolved_paths = getResolvedLibraryPaths();
+  for (auto itr = resolved_paths.begin(); itr != resolved_paths.end(); ) {
+    if (itr->second.canonical_path == library_path) {
+      itr = resolved_paths.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+// The loading context is per thread: static initializers run on the thread that called dlopen(),
+// so factories are attributed to the right ClassLoader even while other threads load libraries.
 std::string & getCurrentlyLoadingLibraryNameReference()
 {
-  static std::string library_name;
+  static thread_local std::string library_name;
   return library_name;
 }
 
@@ -105,7 +555,7 @@ void setCurrentlyLoadingLibraryName(const std::string & library_name)
 
 ClassLoader * & getCurrentlyActiveClassLoaderReference()
 {
-  static ClassLoader * loader = nullptr;
+  static thread_local ClassLoader * loader = nullptr;
   return loader;
 }
 
@@ -154,7 +604,6 @@ MetaObjectVector allMetaObjects()
 
   MetaObjectVector all_meta_objs;
   BaseToFactoryMapMap & factory_map_map = getGlobalPluginBaseToFactoryMapMap();
-  BaseToFactoryMapMap::iterator itr;
 
   for (auto & it : factory_map_map) {
     MetaObjectVector objs = allMetaObjects(it.second);
@@ -163,47 +612,230 @@ MetaObjectVector allMetaObjects()
   return all_meta_objs;
 }
 
-MetaObjectVector
-filterAllMetaObjectsOwnedBy(const MetaObjectVector & to_filter, const ClassLoader * owner)
+// Secondary indexes over the MetaObjects currently registered in the global factory map map.
+// Both are protected by getPluginBaseToFactoryMapMapMutex() and are kept up to date
+// incrementally, so queries about a library or a ClassLoader never have to scan the registry.
+
+/**
+ * @brief What is known about a library: the MetaObjects it registered and the ClassLoaders bound to it. A ClassLoader owns either all or none of the factories of a library, so ownership is tracked here once rather than by every MetaObject.
+ */
+struct LibraryRecord
 {
-  MetaObjectVector filtered_objs;
-  for (auto & f : to_filter) {
-    if (f->isOwnedBy(owner)) {
-      filtered_objs.push_back(f);
-    }
+  MetaObjectVector meta_objects;
+  ClassLoaderSet owners;
+  /// Copy of owners shared by the entries of published snapshots, reset whenever owners changes
+  std::shared_ptr<const ClassLoaderSet> published_owners;
+};
+
+typedef StringHashMap<LibraryRecord> LibraryRecordMap;
+typedef StringHashMap<MetaObjectVector> LibraryToMetaObjectsMap;
+typedef std::unordered_map<const ClassLoader *, std::unordered_set<std::string>>
+  ClassLoaderToLibrariesMap;
+
+LibraryRecordMap & getLibraryRecords()
+{
+  static LibraryRecordMap instance;
+  return instance;
+}
+
+ClassLoaderToLibrariesMap & getClassLoaderToLibrariesMap()
+{
+  static ClassLoaderToLibrariesMap instance;
+  return instance;
+}
+
+/**
+ * @brief Gets the graveyard, indexed by the library the MetaObjects in it belong to
+ */
+LibraryToMetaObjectsMap & getMetaObjectGraveyard()
+{
+  static LibraryToMetaObjectsMap instance;
+  return instance;
+}
+
+/**
+ * @brief Counts the MetaObjects destroyed because their library had left memory when it was closed
+ */
+size_t & getReclaimedGraveyardMetaObjectCount()
+{
+  static size_t count = 0;
+  return count;
+}
+
+LibraryRecord * findLibraryRecord(const std::string & library_path)
+{
+  LibraryRecordMap & records = getLibraryRecords();
+  LibraryRecordMap::iterator itr = records.find(library_path);
+  return itr == records.end() ? nullptr : &itr->second;
+}
+
+/**
+ * @brief Forgets a library once it has no MetaObjects registered and no ClassLoader bound to it
+ */
+void eraseLibraryRecordIfUnused(const std::string & library_path)
+{
+  LibraryRecordMap & records = getLibraryRecords();
+  LibraryRecordMap::iterator itr = records.find(library_path);
+  if (itr != records.end() && itr->second.meta_objects.empty() && itr->second.owners.empty()) {
+    records.erase(itr);
   }
-  return filtered_objs;
 }
 
-MetaObjectVector
-filterAllMetaObjectsAssociatedWithLibrary(
-  const MetaObjectVector & to_filter, const std::string & library_path)
+/**
+ * @brief Marks the base classes of a library's factories as stale, as their snapshot entries carry the library's owners
+ */
+void markLibraryFactoriesStale(const LibraryRecord & record)
+{
+  for (auto & meta_obj : record.meta_objects) {
+    markFactoryRegistrySnapshotStale(meta_obj->typeidBaseClassName());
+  }
+}
+
+void attachClassLoaderToLibrary(const std::string & library_path, ClassLoader * loader)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord & record = getLibraryRecords()[library_path];
+  if (record.owners.insert(loader).second) {
+    record.published_owners.reset();
+    getClassLoaderToLibrariesMap()[loader].insert(library_path);
+    markLibraryFactoriesStale(record);
+  }
+}
+
+bool detachClassLoaderFromLibrary(const std::string & library_path, const ClassLoader * loader)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  if (nullptr == record || 0 == record->owners.erase(loader)) {
+    return false;
+  }
+  record->published_owners.reset();
+  ClassLoaderToLibrariesMap & loader_map = getClassLoaderToLibrariesMap();
+  ClassLoaderToLibrariesMap::iterator loader_itr = loader_map.find(loader);
+  assert(loader_itr != loader_map.end());
+  loader_itr->second.erase(library_path);
+  if (loader_itr->second.empty()) {
+    loader_map.erase(loader_itr);
+  }
+  markLibraryFactoriesStale(*record);
+  eraseLibraryRecordIfUnused(library_path);
+  return true;
+}
+
+bool isLibraryOwnedBy(const std::string & library_path, const ClassLoader * loader)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  return nullptr != record && record->owners.count(loader) > 0;
+}
+
+bool isLibraryOwnedByAnybody(const std::string & library_path)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  return nullptr != record && !record->owners.empty();
+}
+
+ClassLoaderVector getLibraryOwners(const std::string & library_path)
 {
-  MetaObjectVector filtered_objs;
-  for (auto & f : to_filter) {
-    if (f->getAssociatedLibraryPath() == library_path) {
-      filtered_objs.push_back(f);
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  ClassLoaderVector owners;
+  LibraryRecord * record = findLibraryRecord(library_path);
+  if (nullptr != record) {
+    for (auto & loader : record->owners) {
+      // Owners are only ever attached through non-const pointers
+      owners.push_back(const_cast<ClassLoader *>(loader));
     }
   }
-  return filtered_objs;
+  return owners;
 }
 
-MetaObjectVector
-allMetaObjectsForClassLoader(const ClassLoader * owner)
+/**
+ * @brief Gets the owners of a library as published with the factory registry snapshot. The set is shared by all factories of the library and only copied again once its owners changed.
+ */
+std::shared_ptr<const ClassLoaderSet> getPublishedLibraryOwners(const std::string & library_path)
 {
-  return filterAllMetaObjectsOwnedBy(allMetaObjects(), owner);
+  LibraryRecord * record = findLibraryRecord(library_path);
+  if (nullptr == record) {
+    return nullptr;
+  }
+  if (!record->published_owners) {
+    record->published_owners = std::make_shared<const ClassLoaderSet>(record->owners);
+  }
+  return record->published_owners;
+}
+
+void addMetaObjectToIndexes(AbstractMetaObjectBase * meta_obj)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  markFactoryRegistrySnapshotStale(meta_obj->typeidBaseClassName());
+  getLibraryRecords()[meta_obj->getAssociatedLibraryPath()].meta_objects.push_back(meta_obj);
+}
+
+void removeMetaObjectFromIndexes(AbstractMetaObjectBase * meta_obj)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  std::string library_path = meta_obj->getAssociatedLibraryPath();
+  LibraryRecord * record = findLibraryRecord(library_path);
+  if (nullptr == record) {
+    return;
+  }
+  MetaObjectVector & meta_objs = record->meta_objects;
+  MetaObjectVector::iterator itr = std::find(meta_objs.begin(), meta_objs.end(), meta_obj);
+  if (itr == meta_objs.end()) {
+    return;
+  }
+  meta_objs.erase(itr);
+  eraseLibraryRecordIfUnused(library_path);
+  markFactoryRegistrySnapshotStale(meta_obj->typeidBaseClassName());
 }
 
 MetaObjectVector
 allMetaObjectsForLibrary(const std::string & library_path)
 {
-  return filterAllMetaObjectsAssociatedWithLibrary(allMetaObjects(), library_path);
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  return nullptr == record ? MetaObjectVector() : record->meta_objects;
 }
 
 MetaObjectVector
 allMetaObjectsForLibraryOwnedBy(const std::string & library_path, const ClassLoader * owner)
 {
-  return filterAllMetaObjectsOwnedBy(allMetaObjectsForLibrary(library_path), owner);
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  return nullptr != record && record->owners.count(owner) > 0 ?
+         record->meta_objects : MetaObjectVector();
+}
+
+MetaObjectVector
+allMetaObjectsForClassLoader(const ClassLoader * owner)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  MetaObjectVector all_meta_objs;
+  ClassLoaderToLibrariesMap & loader_map = getClassLoaderToLibrariesMap();
+  ClassLoaderToLibrariesMap::iterator loader_itr = loader_map.find(owner);
+  if (loader_itr != loader_map.end()) {
+    for (auto & library_path : loader_itr->second) {
+      MetaObjectVector objs = allMetaObjectsForLibrary(library_path);
+      all_meta_objs.insert(all_meta_objs.end(), objs.begin(), objs.end());
+    }
+  }
+  return all_meta_objs;
+}
+
+size_t numberOfMetaObjectsForLibrary(const std::string & library_path)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  return nullptr == record ? 0 : record->meta_objects.size();
+}
+
+size_t numberOfMetaObjectsForLibraryOwnedBy(
+  const std::string & library_path, const ClassLoader * owner)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryRecord * record = findLibraryRecord(library_path);
+  return nullptr != record && record->owners.count(owner) > 0 ? record->meta_objects.size() : 0;
 }
 
 void insertMetaObjectIntoGraveyard(AbstractMetaObjectBase * meta_obj)
@@ -213,45 +845,27 @@ void insertMetaObjectIntoGraveyard(AbstractMetaObjectBase * meta_obj)
     "Inserting MetaObject (class = %s, base_class = %s, ptr = %p) into graveyard",
     meta_obj->className().c_str(), meta_obj->baseClassName().c_str(),
     reinterpret_cast<void *>(meta_obj));
-  getMetaObjectGraveyard().push_back(meta_obj);
-}
-
-void destroyMetaObjectsForLibrary(
-  const std::string & library_path, FactoryMap & factories, const ClassLoader * loader)
-{
-  FactoryMap::iterator factory_itr = factories.begin();
-  while (factory_itr != factories.end()) {
-    AbstractMetaObjectBase * meta_obj = factory_itr->second;
-    if (meta_obj->getAssociatedLibraryPath() == library_path && meta_obj->isOwnedBy(loader)) {
-      meta_obj->removeOwningClassLoader(loader);
-      if (!meta_obj->isOwnedByAnybody()) {
-        FactoryMap::iterator factory_itr_copy = factory_itr;
-        factory_itr++;
-        // TODO(mikaelarguedas) fix this when branching out for melodic
-        // Note: map::erase does not return iterator like vector::erase does.
-        // Hence the ugliness of this code and a need for copy. Should be fixed in next C++ revision
-        factories.erase(factory_itr_copy);
-
-        // Insert into graveyard
-        // We remove the metaobject from its factory map, but we don't destroy it...instead it
-        // saved to a "graveyard" to the side.
-        // This is due to our static global variable initialization problem that causes factories
-        // to not be registered when a library is closed and then reopened.
-        // This is because it's truly not closed due to the use of global symbol binding i.e.
-        // calling dlopen with RTLD_GLOBAL instead of RTLD_LOCAL.
-        // We require using the former as the which is required to support RTTI
-        insertMetaObjectIntoGraveyard(meta_obj);
-      } else {
-        ++factory_itr;
-      }
-    } else {
-      ++factory_itr;
-    }
+  getMetaObjectGraveyard()[meta_obj->getAssociatedLibraryPath()].push_back(meta_obj);
+}
+
+/**
+ * @brief Destroys the pooled instances of MetaObjects that were just buried. This runs plugin destructors, so it must not happen with the factory map map mutex held, but before the library that defines them is closed.
+ */
+void trimInstancePools(const MetaObjectVector & meta_objs)
+{
+  for (auto & meta_obj : meta_objs) {
+    meta_obj->trimInstancePool();
   }
 }
 
-void destroyMetaObjectsForLibrary(const std::string & library_path, const ClassLoader * loader)
+/**
+ * @brief Unbinds loader from a library and, if no other ClassLoader is bound to it any more, moves its MetaObjects from the factory map map into the graveyard
+ * @return The MetaObjects that were buried
+ */
+MetaObjectVector buryMetaObjectsForLibrary(
+  const std::string & library_path, const ClassLoader * loader)
 {
+  MetaObjectVector buried_objs;
   boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
 
   CONSOLE_BRIDGE_logDebug(
@@ -260,38 +874,59 @@ void destroyMetaObjectsForLibrary(const std::string & library_path, const ClassL
     "plugin-to-factorymap map.\n",
     library_path.c_str(), reinterpret_cast<const void *>(loader));
 
-  // We have to walk through all FactoryMaps to be sure
-  BaseToFactoryMapMap & factory_map_map = getGlobalPluginBaseToFactoryMapMap();
-  for (auto & it : factory_map_map) {
-    destroyMetaObjectsForLibrary(library_path, it.second, loader);
+  // The factories stay registered as long as any ClassLoader is still bound to the library
+  LibraryRecord * record = nullptr;
+  if (detachClassLoaderFromLibrary(library_path, loader)) {
+    record = findLibraryRecord(library_path);
   }
+  if (nullptr != record && record->owners.empty()) {
+    MetaObjectVector meta_objs;
+    meta_objs.swap(record->meta_objects);
+    eraseLibraryRecordIfUnused(library_path);
+    for (auto & meta_obj : meta_objs) {
+      markFactoryRegistrySnapshotStale(meta_obj->typeidBaseClassName());
+      FactoryMap & factories = getFactoryMapForBaseClass(meta_obj->typeidBaseClassName());
+      FactoryMap::iterator factory_itr = factories.find(meta_obj->className());
+      if (factory_itr != factories.end() && factory_itr->second == meta_obj) {
+        factories.erase(factory_itr);
+      }
 
-  CONSOLE_BRIDGE_logDebug("%s", "class_loader.impl: Metaobjects removed.");
+      // Insert into graveyard
+      // We remove the metaobject from its factory map, but we don't destroy it...instead it
+      // saved to a "graveyard" to the side.
+      // This is due to our static global variable initialization problem that causes factories
+      // to not be registered when a library is closed and then reopened.
+      // This is because it's truly not closed due to the use of global symbol binding i.e.
+      // calling dlopen with RTLD_GLOBAL instead of RTLD_LOCAL.
+      // We require using the former as the which is required to support RTTI
+      insertMetaObjectIntoGraveyard(meta_obj);
+    }
+    buried_objs.swap(meta_objs);
+  }
+  publishFactoryRegistrySnapshot();
+  return buried_objs;
 }
 
-bool areThereAnyExistingMetaObjectsForLibrary(const std::string & library_path)
+void destroyMetaObjectsForLibrary(const std::string & library_path, const ClassLoader * loader)
 {
-  return allMetaObjectsForLibrary(library_path).size() > 0;
+  trimInstancePools(buryMetaObjectsForLibrary(library_path, loader));
+
+  CONSOLE_BRIDGE_logDebug("%s", "class_loader.impl: Metaobjects removed.");
 }
 
-// Loaded Library Vector manipulation
-LibraryVector::iterator findLoadedLibrary(const std::string & library_path)
+bool areThereAnyExistingMetaObjectsForLibrary(const std::string & library_path)
 {
-  LibraryVector & open_libraries = getLoadedLibraryVector();
-  for (auto it = open_libraries.begin(); it != open_libraries.end(); ++it) {
-    if (it->first == library_path) {
-      return it;
-    }
-  }
-  return open_libraries.end();
+  return numberOfMetaObjectsForLibrary(library_path) > 0;
 }
 
-bool isLibraryLoadedByAnybody(const std::string & library_path)
+// Loaded Library Map manipulation
+
+bool isCanonicalLibraryLoaded(const std::string & library_path)
 {
-  boost::recursive_mutex::scoped_lock lock(getLoadedLibraryVectorMutex());
+  boost::recursive_mutex::scoped_lock lock(getLoadedLibraryMapMutex());
 
-  LibraryVector & open_libraries = getLoadedLibraryVector();
-  LibraryVector::iterator itr = findLoadedLibrary(library_path);
+  LibraryMap & open_libraries = getLoadedLibraryMap();
+  LibraryMap::iterator itr = open_libraries.find(library_path);
 
   if (itr != open_libraries.end()) {
     assert(itr->second->isLoaded() == true);  // Ensure Poco actually thinks the library is loaded
@@ -301,12 +936,22 @@ bool isLibraryLoadedByAnybody(const std::string & library_path)
   }
 }
 
+bool isLibraryLoadedByAnybody(const std::string & library_path)
+{
+  return isCanonicalLibraryLoaded(getCanonicalLibraryPath(library_path));
+}
+
 bool isLibraryLoaded(const std::string & library_path, ClassLoader * loader)
 {
-  bool is_lib_loaded_by_anyone = isLibraryLoadedByAnybody(library_path);
-  size_t num_meta_objs_for_lib = allMetaObjectsForLibrary(library_path).size();
+  return isCanonicalLibraryLoadedBy(getCanonicalLibraryPath(library_path), loader);
+}
+
+bool isCanonicalLibraryLoadedBy(const std::string & library_path, ClassLoader * loader)
+{
+  bool is_lib_loaded_by_anyone = isCanonicalLibraryLoaded(library_path);
+  size_t num_meta_objs_for_lib = numberOfMetaObjectsForLibrary(library_path);
   size_t num_meta_objs_for_lib_bound_to_loader =
-    allMetaObjectsForLibraryOwnedBy(library_path, loader).size();
+    numberOfMetaObjectsForLibraryOwnedBy(library_path, loader);
   bool are_meta_objs_bound_to_loader =
     (0 == num_meta_objs_for_lib) ? true : (
     num_meta_objs_for_lib_bound_to_loader <= num_meta_objs_for_lib);
@@ -316,134 +961,291 @@ bool isLibraryLoaded(const std::string & library_path, ClassLoader * loader)
 
 std::vector<std::string> getAllLibrariesUsedByClassLoader(const ClassLoader * loader)
 {
-  MetaObjectVector all_loader_meta_objs = allMetaObjectsForClassLoader(loader);
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
   std::vector<std::string> all_libs;
-  for (auto & meta_obj : all_loader_meta_objs) {
-    std::string lib_path = meta_obj->getAssociatedLibraryPath();
-    if (std::find(all_libs.begin(), all_libs.end(), lib_path) == all_libs.end()) {
-      all_libs.push_back(lib_path);
+  ClassLoaderToLibrariesMap & loader_map = getClassLoaderToLibrariesMap();
+  ClassLoaderToLibrariesMap::iterator loader_itr = loader_map.find(loader);
+  if (loader_itr != loader_map.end()) {
+    for (auto & library_path : loader_itr->second) {
+      // Only libraries that provide factories are in use. The library of the ClassLoader itself
+      // is reported by the path it was requested by.
+      if (0 == numberOfMetaObjectsForLibrary(library_path)) {
+        continue;
+      }
+      if (library_path == loader->getCanonicalLibraryPath()) {
+        all_libs.push_back(const_cast<ClassLoader *>(loader)->getLibraryPath());
+      } else {
+        all_libs.push_back(library_path);
+      }
     }
   }
   return all_libs;
 }
 
+std::vector<std::pair<std::string, std::string>> getOwnedClassesOfAllBases(
+  const ClassLoader * loader)
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  std::vector<std::pair<std::string, std::string>> classes;
+  for (auto & base : getGlobalPluginBaseToFactoryMapMap()) {
+    for (auto & factory : base.second) {
+      if (factory.second->isOwnedBy(loader)) {
+        classes.push_back(std::make_pair(base.first, factory.first));
+      }
+    }
+  }
+  return classes;
+}
+
 
 // Implementation of Remaining Core plugin impl Functions
 
-void addClassLoaderOwnerForAllExistingMetaObjectsForLibrary(
+/**
+ * @brief Registers the graveyarded MetaObjects of a library again
+ * @return The MetaObjects of other libraries that were registered for the same classes and got buried in their place
+ */
+MetaObjectVector revivePreviouslyCreateMetaobjectsFromGraveyard(
   const std::string & library_path, ClassLoader * loader)
 {
-  MetaObjectVector all_meta_objs = allMetaObjectsForLibrary(library_path);
-  for (auto & meta_obj : all_meta_objs) {
+  MetaObjectVector displaced_objs;
+  boost::recursive_mutex::scoped_lock b2fmm_lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryToMetaObjectsMap & graveyard = getMetaObjectGraveyard();
+  LibraryToMetaObjectsMap::iterator graveyard_itr = graveyard.find(library_path);
+  if (graveyard_itr == graveyard.end()) {
+    return displaced_objs;
+  }
+
+  attachClassLoaderToLibrary(library_path, loader);
+  for (auto & obj : graveyard_itr->second) {
     CONSOLE_BRIDGE_logDebug(
       "class_loader.impl: "
-      "Tagging existing MetaObject %p (base = %s, derived = %s) with "
-      "class loader %p (library path = %s).",
-      reinterpret_cast<void *>(meta_obj), meta_obj->baseClassName().c_str(),
-      meta_obj->className().c_str(),
+      "Resurrected factory metaobject from graveyard, class = %s, base_class = %s ptr = %p..."
+      "bound to ClassLoader %p (library path = %s)",
+      obj->className().c_str(), obj->baseClassName().c_str(), reinterpret_cast<void *>(obj),
       reinterpret_cast<void *>(loader),
-      nullptr == loader ? loader->getLibraryPath().c_str() : "NULL");
-    meta_obj->addOwningClassLoader(loader);
+      nullptr != loader ? loader->getLibraryPath().c_str() : "NULL");
+
+    assert(obj->typeidBaseClassName() != "UNSET");
+    FactoryMap & factory = getFactoryMapForBaseClass(obj->typeidBaseClassName());
+    AbstractMetaObjectBase * & factory_slot = factory[obj->className()];
+    if (factory_slot != nullptr) {
+      removeMetaObjectFromIndexes(factory_slot);
+      displaced_objs.push_back(factory_slot);
+    }
+    factory_slot = obj;
+    addMetaObjectToIndexes(obj);
   }
+
+  // A factory of the same class registered by another library is buried like the factories of
+  // an unloaded library, so it is revived or destroyed along with its own library. This happens
+  // after the loop as inserting into the graveyard invalidates graveyard_itr.
+  for (auto & obj : displaced_objs) {
+    insertMetaObjectIntoGraveyard(obj);
+  }
+  return displaced_objs;
 }
 
-void revivePreviouslyCreateMetaobjectsFromGraveyard(
-  const std::string & library_path, ClassLoader * loader)
+/**
+ * @brief Indicates if a MetaObject is the one registered in the global factory map for its class
+ */
+bool isRegisteredMetaObject(AbstractMetaObjectBase * meta_obj)
 {
-  boost::recursive_mutex::scoped_lock b2fmm_lock(getPluginBaseToFactoryMapMapMutex());
-  MetaObjectVector & graveyard = getMetaObjectGraveyard();
-
-  for (auto & obj : graveyard) {
-    if (obj->getAssociatedLibraryPath() == library_path) {
-      CONSOLE_BRIDGE_logDebug(
-        "class_loader.impl: "
-        "Resurrected factory metaobject from graveyard, class = %s, base_class = %s ptr = %p..."
-        "bound to ClassLoader %p (library path = %s)",
-        obj->className().c_str(), obj->baseClassName().c_str(), reinterpret_cast<void *>(obj),
-        reinterpret_cast<void *>(loader),
-        nullptr == loader ? loader->getLibraryPath().c_str() : "NULL");
-
-      obj->addOwningClassLoader(loader);
-      assert(obj->typeidBaseClassName() != "UNSET");
-      FactoryMap & factory = getFactoryMapForBaseClass(obj->typeidBaseClassName());
-      factory[obj->className()] = obj;
-    }
+  BaseToFactoryMapMap & factory_map_map = getGlobalPluginBaseToFactoryMapMap();
+  BaseToFactoryMapMap::iterator base_itr = factory_map_map.find(meta_obj->typeidBaseClassName());
+  if (base_itr == factory_map_map.end()) {
+    return false;
   }
+  FactoryMap::iterator factory_itr = base_itr->second.find(meta_obj->className());
+  return factory_itr != base_itr->second.end() && factory_itr->second == meta_obj;
 }
 
 void purgeGraveyardOfMetaobjects(
   const std::string & library_path, ClassLoader * loader, bool delete_objs)
 {
-  MetaObjectVector all_meta_objs = allMetaObjects();
-  // Note: Lock must happen after call to allMetaObjects as that will lock
   boost::recursive_mutex::scoped_lock b2fmm_lock(getPluginBaseToFactoryMapMapMutex());
 
-  MetaObjectVector & graveyard = getMetaObjectGraveyard();
-  MetaObjectVector::iterator itr = graveyard.begin();
+  LibraryToMetaObjectsMap & graveyard = getMetaObjectGraveyard();
+  LibraryToMetaObjectsMap::iterator graveyard_itr = graveyard.find(library_path);
+  if (graveyard_itr == graveyard.end()) {
+    return;
+  }
+  MetaObjectVector buried_objs;
+  buried_objs.swap(graveyard_itr->second);
+  graveyard.erase(graveyard_itr);
 
-  while (itr != graveyard.end()) {
-    AbstractMetaObjectBase * obj = *itr;
-    if (obj->getAssociatedLibraryPath() == library_path) {
-      CONSOLE_BRIDGE_logDebug(
-        "class_loader.impl: "
-        "Purging factory metaobject from graveyard, class = %s, base_class = %s ptr = %p.."
-        ".bound to ClassLoader %p (library path = %s)",
-        obj->className().c_str(), obj->baseClassName().c_str(), reinterpret_cast<void *>(obj),
-        reinterpret_cast<void *>(loader),
-        nullptr == loader ? loader->getLibraryPath().c_str() : "NULL");
-
-      bool is_address_in_graveyard_same_as_global_factory_map =
-        std::find(all_meta_objs.begin(), all_meta_objs.end(), *itr) != all_meta_objs.end();
-      itr = graveyard.erase(itr);
-      if (delete_objs) {
-        if (is_address_in_graveyard_same_as_global_factory_map) {
-          CONSOLE_BRIDGE_logDebug("%s",
-            "class_loader.impl: "
-            "Newly created metaobject factory in global factory map map has same address as "
-            "one in graveyard -- metaobject has been purged from graveyard but not deleted.");
-        } else {
-          assert(hasANonPurePluginLibraryBeenOpened() == false);
-          CONSOLE_BRIDGE_logDebug(
-            "class_loader.impl: "
-            "Also destroying metaobject %p (class = %s, base_class = %s, library_path = %s) "
-            "in addition to purging it from graveyard.",
-            reinterpret_cast<void *>(obj), obj->className().c_str(), obj->baseClassName().c_str(),
-            obj->getAssociatedLibraryPath().c_str());
+  for (auto & obj : buried_objs) {
+    CONSOLE_BRIDGE_logDebug(
+      "class_loader.impl: "
+      "Purging factory metaobject from graveyard, class = %s, base_class = %s ptr = %p.."
+      ".bound to ClassLoader %p (library path = %s)",
+      obj->className().c_str(), obj->baseClassName().c_str(), reinterpret_cast<void *>(obj),
+      reinterpret_cast<void *>(loader),
+      nullptr != loader ? loader->getLibraryPath().c_str() : "NULL");
+
+    if (delete_objs) {
+      if (isRegisteredMetaObject(obj)) {
+        CONSOLE_BRIDGE_logDebug("%s",
+          "class_loader.impl: "
+          "Newly created metaobject factory in global factory map map has same address as "
+          "one in graveyard -- metaobject has been purged from graveyard but not deleted.");
+      } else {
+        assert(hasANonPurePluginLibraryBeenOpened() == false);
+        CONSOLE_BRIDGE_logDebug(
+          "class_loader.impl: "
+          "Also destroying metaobject %p (class = %s, base_class = %s, library_path = %s) "
+          "in addition to purging it from graveyard.",
+          reinterpret_cast<void *>(obj), obj->className().c_str(), obj->baseClassName().c_str(),
+          obj->getAssociatedLibraryPath().c_str());
+        // Lock free readers may still be using it, so it is reclaimed once they are done
+        retireObject([obj]() {
 #ifndef _WIN32
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdelete-non-virtual-dtor"
 #endif
-          delete (obj);  // Note: This is the only place where metaobjects can be destroyed
+            delete (obj);  // Note: This is the only place where metaobjects can be destroyed
 #ifndef _WIN32
 #pragma GCC diagnostic pop
 #endif
-        }
+          });
       }
-    } else {
-      itr++;
     }
   }
 }
 
-void loadLibrary(const std::string & library_path, ClassLoader * loader)
+/**
+ * @brief Indicates if a library Poco closed is still mapped into the process, which is the case when another library depends on it or it defines unique symbols. Only then can its graveyarded MetaObjects be revived, as opening it again reruns its static initializers otherwise.
+ */
+bool isLibraryStillMapped(const std::string & library_path)
+{
+#ifdef __linux__
+  void * handle = dlopen(library_path.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  if (nullptr == handle) {
+    return false;
+  }
+  dlclose(handle);
+#else
+  (void)library_path;
+#endif
+  return true;
+}
+
+/**
+ * @brief Destroys the graveyarded MetaObjects of a library that was just closed and left memory, so the graveyard only holds MetaObjects that may still be revived
+ * @note The caller checks isLibraryStillMapped() before, without holding any class_loader mutex: that takes the lock of the dynamic linker, which a library being opened on another thread holds while its static initializers wait for the factory map mutex.
+ */
+void reclaimGraveyardOfUnmappedLibrary(const std::string & library_path, ClassLoader * loader)
 {
-  static boost::recursive_mutex loader_mutex;
+  boost::recursive_mutex::scoped_lock b2fmm_lock(getPluginBaseToFactoryMapMapMutex());
+  LibraryToMetaObjectsMap & graveyard = getMetaObjectGraveyard();
+  LibraryToMetaObjectsMap::iterator graveyard_itr = graveyard.find(library_path);
+  // MetaObjects registered outside of a library load cannot be told apart, so they are kept
+  if (graveyard_itr == graveyard.end() || hasANonPurePluginLibraryBeenOpened()) {
+    return;
+  }
   CONSOLE_BRIDGE_logDebug(
     "class_loader.impl: "
-    "Attempting to load library %s on behalf of ClassLoader handle %p...\n",
-    library_path.c_str(), reinterpret_cast<void *>(loader));
-  boost::recursive_mutex::scoped_lock loader_lock(loader_mutex);
+    "Library %s left memory, destroying its %zu graveyarded metaobjects.",
+    library_path.c_str(), graveyard_itr->second.size());
+  getReclaimedGraveyardMetaObjectCount() += graveyard_itr->second.size();
+  purgeGraveyardOfMetaobjects(library_path, loader, true);
+}
 
-  // If it's already open, just update existing metaobjects to have an additional owner.
-  if (isLibraryLoadedByAnybody(library_path)) {
-    boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
-    CONSOLE_BRIDGE_logDebug("%s",
-      "class_loader.impl: "
-      "Library already in memory, but binding existing MetaObjects to loader if necesesary.\n");
-    addClassLoaderOwnerForAllExistingMetaObjectsForLibrary(library_path, loader);
-    return;
+// Loads and unloads in progress, by library path. Operations on the same library run one at a
+// time, while those on different libraries do not wait for each other. A thread that wants to
+// load a library another thread is opening waits for it and shares its outcome instead of
+// opening the library again.
+
+struct LibraryOperation
+{
+  explicit LibraryOperation(bool is_open)
+  : is_open(is_open), thread(std::this_thread::get_id()), done(false) {}
+
+  const bool is_open;
+  const std::thread::id thread;
+  bool done;
+  std::exception_ptr error;
+};
+
+typedef std::map<std::string, std::shared_ptr<LibraryOperation>> LibraryOperationMap;
+
+boost::mutex & getLibraryOperationsMutex()
+{
+  static boost::mutex m;
+  return m;
+}
+
+boost::condition_variable & getLibraryOperationsCondition()
+{
+  static boost::condition_variable condition;
+  return condition;
+}
+
+LibraryOperationMap & getLibraryOperations()
+{
+  static LibraryOperationMap instance;
+  return instance;
+}
+
+/**
+ * @brief Waits until no other thread operates on a library, then marks the calling thread as doing so
+ * @param library_path - The library about to be loaded or unloaded
+ * @param is_load - Whether the operation is a load, which opens the library unless it is already loaded
+ * @return The operation, to be passed to finishLibraryOperation(). Its is_open member tells whether a load has to open the library.
+ * @throws The exception a load that was opening the library failed with while the calling thread waited, if is_load
+ * @throws class_loader::LibraryLoadException or class_loader::LibraryUnloadException if the calling thread is already loading or unloading the library, e.g. when a static initializer of the library loads it again, as it would wait for itself
+ */
+std::shared_ptr<LibraryOperation> beginLibraryOperation(
+  const std::string & library_path, bool is_load)
+{
+  boost::mutex::scoped_lock lock(getLibraryOperationsMutex());
+  LibraryOperationMap & operations = getLibraryOperations();
+  for (;; ) {
+    LibraryOperationMap::iterator itr = operations.find(library_path);
+    if (itr == operations.end()) {
+      break;
+    }
+    std::shared_ptr<LibraryOperation> other = itr->second;
+    if (other->thread == std::this_thread::get_id()) {
+      const std::string message =
+        "Library " + library_path + " is already being loaded or unloaded by the calling thread";
+      if (is_load) {
+        throw class_loader::LibraryLoadException(message);
+      }
+      throw class_loader::LibraryUnloadException(message);
+    }
+    while (!other->done) {
+      getLibraryOperationsCondition().wait(lock);
+    }
+    if (is_load && other->is_open && other->error) {
+      std::rethrow_exception(other->error);
+    }
+  }
+
+  std::shared_ptr<LibraryOperation> operation = std::make_shared<LibraryOperation>(
+    is_load && !isCanonicalLibraryLoaded(library_path));
+  operations[library_path] = operation;
+  return operation;
+}
+
+/**
+ * @brief Lets the threads waiting in beginLibraryOperation() for a library proceed
+ */
+void finishLibraryOperation(
+  const std::string & library_path, const std::shared_ptr<LibraryOperation> & operation)
+{
+  {
+    boost::mutex::scoped_lock lock(getLibraryOperationsMutex());
+    operation->done = true;
+    getLibraryOperations().erase(library_path);
   }
+  getLibraryOperationsCondition().notify_all();
+}
 
+/**
+ * @brief Opens a library that is not loaded yet and registers its factories on behalf of loader. Only one thread at a time does this for a given library path.
+ */
+void openLibrary(const std::string & library_path, ClassLoader * loader)
+{
   Poco::SharedLibrary * library_handle = nullptr;
 
   {
@@ -486,7 +1288,7 @@ void loadLibrary(const std::string & library_path, ClassLoader * loader)
       "Though the library %s was just loaded, it seems no factory metaobjects were registered. "
       "Checking factory graveyard for previously loaded metaobjects...",
       library_path.c_str());
-    revivePreviouslyCreateMetaobjectsFromGraveyard(library_path, loader);
+    trimInstancePools(revivePreviouslyCreateMetaobjectsFromGraveyard(library_path, loader));
     // Note: The 'false' indicates we don't want to invoke delete on the metaobject
     purgeGraveyardOfMetaobjects(library_path, loader, false);
   } else {
@@ -498,14 +1300,128 @@ void loadLibrary(const std::string & library_path, ClassLoader * loader)
     purgeGraveyardOfMetaobjects(library_path, loader, true);
   }
 
-  // Insert library into global loaded library vector
-  boost::recursive_mutex::scoped_lock llv_lock(getLoadedLibraryVectorMutex());
-  LibraryVector & open_libraries = getLoadedLibraryVector();
+  // Make the factories visible to lock free readers before the library is reported as loaded
+  requestFactoryRegistrySnapshot();
+
+  // Insert library into global loaded library map
+  boost::recursive_mutex::scoped_lock llm_lock(getLoadedLibraryMapMutex());
   // Note: Poco::SharedLibrary automatically calls load() when library passed to constructor
-  open_libraries.push_back(LibraryPair(library_path, library_handle));
+  getLoadedLibraryMap()[library_path] = library_handle;
+  rememberLoadedLibraryFile(library_path);
+}
+
+std::atomic<std::uint64_t> & getLibraryGenerationCounter()
+{
+  // Starts at one so that zero can stand for "never seen loaded"
+  static std::atomic<std::uint64_t> generation(1);
+  return generation;
+}
+
+std::uint64_t getLibraryGeneration()
+{
+  return getLibraryGenerationCounter().load(std::memory_order_acquire);
+}
+
+void loadLibrary(const std::string & library_path, ClassLoader * loader)
+{
+  // Aliases of a library share its handle and MetaObjects
+  loadCanonicalLibrary(getCanonicalLibraryPath(library_path), loader);
+}
+
+void loadCanonicalLibrary(const std::string & library_path, ClassLoader * loader)
+{
+  CONSOLE_BRIDGE_logDebug(
+    "class_loader.impl: "
+    "Attempting to load library %s on behalf of ClassLoader handle %p...\n",
+    library_path.c_str(), reinterpret_cast<void *>(loader));
+  std::shared_ptr<LibraryOperation> operation = beginLibraryOperation(library_path, true);
+
+  try {
+    if (operation->is_open) {
+      openLibrary(library_path, loader);
+    } else {
+      // If it's already open, just bind the loader to the library, which owns its MetaObjects.
+      boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+      CONSOLE_BRIDGE_logDebug(
+        "class_loader.impl: "
+        "Library already in memory, binding class loader %p to its existing MetaObjects.\n",
+        reinterpret_cast<void *>(loader));
+      attachClassLoaderToLibrary(library_path, loader);
+      requestFactoryRegistrySnapshot();
+    }
+  } catch (...) {
+    operation->error = std::current_exception();
+  }
+  ++getLibraryGenerationCounter();
+  finishLibraryOperation(library_path, operation);
+
+  if (operation->error) {
+    std::rethrow_exception(operation->error);
+  }
+}
+
+/**
+ * @brief Removes loader's factories for a library and closes the library if no other ClassLoader uses it. Only one thread at a time does this for a given library path.
+ */
+void closeLibrary(const std::string & library_path, ClassLoader * loader)
+{
+  Poco::SharedLibrary * library = nullptr;
+  {
+    boost::recursive_mutex::scoped_lock lock(getLoadedLibraryMapMutex());
+    LibraryMap & open_libraries = getLoadedLibraryMap();
+    LibraryMap::iterator itr = open_libraries.find(library_path);
+    if (itr == open_libraries.end()) {
+      throw class_loader::LibraryUnloadException(
+              "Attempt to unload library that class_loader is unaware of.");
+    }
+    library = itr->second;
+  }
+
+  destroyMetaObjectsForLibrary(library_path, loader);
+
+  // Remove from loaded library list as well if no more factories associated with said library
+  if (areThereAnyExistingMetaObjectsForLibrary(library_path)) {
+    CONSOLE_BRIDGE_logDebug(
+      "class_loader.impl: "
+      "MetaObjects still remain in memory meaning other ClassLoaders are still using library"
+      ", keeping library %s open.",
+      library_path.c_str());
+    return;
+  }
+
+  CONSOLE_BRIDGE_logDebug(
+    "class_loader.impl: "
+    "There are no more MetaObjects left for %s so unloading library and "
+    "removing from loaded library map.\n",
+    library_path.c_str());
+  {
+    boost::recursive_mutex::scoped_lock lock(getLoadedLibraryMapMutex());
+    getLoadedLibraryMap().erase(library_path);
+  }
+  // Closing runs the static destructors of the library, which must not keep isLibraryLoaded()
+  // queries waiting. No other thread loads or unloads the library in the meantime.
+  try {
+    library->unload();
+  } catch (const Poco::RuntimeException & e) {
+    delete (library);
+    throw class_loader::LibraryUnloadException(
+            "Could not unload library (Poco exception = " + std::string(e.message()) + ")");
+  }
+  assert(library->isLoaded() == false);
+  delete (library);
+  // No other thread loads or unloads the library before the graveyard is checked again
+  if (!isLibraryStillMapped(library_path)) {
+    forgetLoadedLibraryFile(library_path);
+    reclaimGraveyardOfUnmappedLibrary(library_path, loader);
+  }
 }
 
 void unloadLibrary(const std::string & library_path, ClassLoader * loader)
+{
+  unloadCanonicalLibrary(getCanonicalLibraryPath(library_path), loader);
+}
+
+void unloadCanonicalLibrary(const std::string & library_path, ClassLoader * loader)
 {
   if (hasANonPurePluginLibraryBeenOpened()) {
     CONSOLE_BRIDGE_logDebug(
@@ -522,48 +1438,44 @@ void unloadLibrary(const std::string & library_path, ClassLoader * loader)
       "class_loader.impl: "
       "Unloading library %s on behalf of ClassLoader %p...",
       library_path.c_str(), reinterpret_cast<void *>(loader));
-    boost::recursive_mutex::scoped_lock lock(getLoadedLibraryVectorMutex());
-    LibraryVector & open_libraries = getLoadedLibraryVector();
-    LibraryVector::iterator itr = findLoadedLibrary(library_path);
-    if (itr != open_libraries.end()) {
-      Poco::SharedLibrary * library = itr->second;
-      std::string library_path = itr->first;
-      try {
-        destroyMetaObjectsForLibrary(library_path, loader);
-
-        // Remove from loaded library list as well if no more factories associated with said library
-        if (!areThereAnyExistingMetaObjectsForLibrary(library_path)) {
-          CONSOLE_BRIDGE_logDebug(
-            "class_loader.impl: "
-            "There are no more MetaObjects left for %s so unloading library and "
-            "removing from loaded library vector.\n",
-            library_path.c_str());
-          library->unload();
-          assert(library->isLoaded() == false);
-          delete (library);
-          itr = open_libraries.erase(itr);
-        } else {
-          CONSOLE_BRIDGE_logDebug(
-            "class_loader.impl: "
-            "MetaObjects still remain in memory meaning other ClassLoaders are still using library"
-            ", keeping library %s open.",
-            library_path.c_str());
-        }
-        return;
-      } catch (const Poco::RuntimeException & e) {
-        delete (library);
-        throw class_loader::LibraryUnloadException(
-                "Could not unload library (Poco exception = " + std::string(e.message()) + ")");
-      }
+    std::shared_ptr<LibraryOperation> operation = beginLibraryOperation(library_path, false);
+    // Invalidates the cached loaded state of the ClassLoaders before the library goes away
+    ++getLibraryGenerationCounter();
+    try {
+      closeLibrary(library_path, loader);
+    } catch (...) {
+      ++getLibraryGenerationCounter();
+      finishLibraryOperation(library_path, operation);
+      throw;
     }
-    throw class_loader::LibraryUnloadException(
-            "Attempt to unload library that class_loader is unaware of.");
+    ++getLibraryGenerationCounter();
+    finishLibraryOperation(library_path, operation);
   }
 }
 
 
 // Other
 
+GraveyardStatistics getGraveyardStatistics()
+{
+  boost::recursive_mutex::scoped_lock lock(getPluginBaseToFactoryMapMapMutex());
+  GraveyardStatistics statistics;
+  statistics.libraries = 0;
+  statistics.meta_objects = 0;
+  statistics.bytes = 0;
+  statistics.reclaimed = getReclaimedGraveyardMetaObjectCount();
+  for (auto & it : getMetaObjectGraveyard()) {
+    ++statistics.libraries;
+    statistics.meta_objects += it.second.size();
+    statistics.bytes += it.first.capacity() + sizeof(it.second) +
+      it.second.capacity() * sizeof(AbstractMetaObjectBase *);
+    for (auto & meta_obj : it.second) {
+      statistics.bytes += meta_obj->memoryUsage();
+    }
+  }
+  return statistics;
+}
+
 void printDebugInfoToScreen()
 {
   printf("*******************************************************************************\n");
@@ -572,12 +1484,12 @@ void printDebugInfoToScreen()
 
   printf("OPEN LIBRARIES IN MEMORY:\n");
   printf("--------------------------------------------------------------------------------\n");
-  boost::recursive_mutex::scoped_lock lock(getLoadedLibraryVectorMutex());
-  LibraryVector libs = getLoadedLibraryVector();
-  for (size_t c = 0; c < libs.size(); c++) {
+  boost::recursive_mutex::scoped_lock lock(getLoadedLibraryMapMutex());
+  size_t c = 0;
+  for (auto & it : getLoadedLibraryMap()) {
     printf(
       "Open library %zu = %s (Poco SharedLibrary handle = %p)\n",
-      c, (libs.at(c)).first.c_str(), reinterpret_cast<void *>((libs.at(c)).second));
+      c++, it.first.c_str(), reinterpret_cast<void *>(it.second));
   }
 
   printf("METAOBJECTS (i.e. FACTORIES) IN MEMORY:\n");
@@ -598,6 +1510,14 @@ void printDebugInfoToScreen()
     printf("--------------------------------------------------------------------------------\n");
   }
 
+  printf("METAOBJECT GRAVEYARD:\n");
+  printf("--------------------------------------------------------------------------------\n");
+  GraveyardStatistics graveyard = getGraveyardStatistics();
+  printf(
+    "%zu metaobjects of %zu libraries, approximately %zu bytes (%zu reclaimed so far)\n",
+    graveyard.meta_objects, graveyard.libraries, graveyard.bytes, graveyard.reclaimed);
+  printf("--------------------------------------------------------------------------------\n");
+
   printf("********************************** END DEBUG **********************************\n");
   printf("*******************************************************************************\n\n");
 }
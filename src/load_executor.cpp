@@ -0,0 +1,93 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "class_loader/load_executor.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <functional>
+#include <thread>
+
+#include "console_bridge/console.h"
+
+namespace class_loader
+{
+
+namespace
+{
+
+/**
+ * @brief Lowers the CPU and I/O scheduling priority of the calling thread as far as possible
+ */
+void lowerThreadPriority()
+{
+#ifdef __linux__
+  sched_param param = sched_param();
+  int error = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+  if (0 != error) {
+    CONSOLE_BRIDGE_logDebug(
+      "class_loader::LoadExecutor: Could not lower the CPU priority of a loader thread (%d).",
+      error);
+  }
+
+  // ioprio_set() has no glibc wrapper, see linux/ioprio.h
+  const int ioprio_who_process = 1;
+  const int ioprio_class_idle = 3;
+  const int ioprio_class_shift = 13;
+  if (0 != syscall(SYS_ioprio_set, ioprio_who_process, 0,
+    ioprio_class_idle << ioprio_class_shift))
+  {
+    CONSOLE_BRIDGE_logDebug("%s",
+      "class_loader::LoadExecutor: Could not lower the I/O priority of a loader thread.");
+  }
+#endif
+}
+
+}  // namespace
+
+LoadExecutor makeThreadLoadExecutor(bool low_priority)
+{
+  return [low_priority](const std::function<void()> & task) {
+           std::thread([low_priority, task]() {
+               if (low_priority) {
+                 lowerThreadPriority();
+               }
+               task();
+             }).detach();
+         };
+}
+
+}  // namespace class_loader
@@ -27,10 +27,13 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <cassert>
 #include <string>
+#include <vector>
 
 #include "class_loader/meta_object.hpp"
 #include "class_loader/class_loader.hpp"
+#include "class_loader/class_loader_core.hpp"
 
 namespace class_loader
 {
@@ -73,6 +76,12 @@ std::string AbstractMetaObjectBase::typeidBaseClassName() const
   return typeid_base_class_name_;
 }
 
+std::size_t AbstractMetaObjectBase::memoryUsage() const
+{
+  return sizeof(*this) + associated_library_path_.capacity() + base_class_name_.capacity() +
+         class_name_.capacity() + typeid_base_class_name_.capacity();
+}
+
 std::string AbstractMetaObjectBase::getAssociatedLibraryPath()
 {
   return associated_library_path_;
@@ -85,36 +94,86 @@ void AbstractMetaObjectBase::setAssociatedLibraryPath(std::string library_path)
 
 void AbstractMetaObjectBase::addOwningClassLoader(ClassLoader * loader)
 {
-  ClassLoaderVector & v = associated_class_loaders_;
-  if (std::find(v.begin(), v.end(), loader) == v.end()) {
-    v.push_back(loader);
-  }
+  attachClassLoaderToLibrary(associated_library_path_, loader);
 }
 
 void AbstractMetaObjectBase::removeOwningClassLoader(const ClassLoader * loader)
 {
-  ClassLoaderVector & v = associated_class_loaders_;
-  ClassLoaderVector::iterator itr = std::find(v.begin(), v.end(), loader);
-  if (itr != v.end()) {
-    v.erase(itr);
-  }
+  detachClassLoaderFromLibrary(associated_library_path_, loader);
 }
 
 bool AbstractMetaObjectBase::isOwnedBy(const ClassLoader * loader)
 {
-  ClassLoaderVector & v = associated_class_loaders_;
-  ClassLoaderVector::iterator itr = std::find(v.begin(), v.end(), loader);
-  return itr != v.end();
+  return isLibraryOwnedBy(associated_library_path_, loader);
 }
 
 bool AbstractMetaObjectBase::isOwnedByAnybody()
 {
-  return associated_class_loaders_.size() > 0;
+  return isLibraryOwnedByAnybody(associated_library_path_);
 }
 
 ClassLoaderVector AbstractMetaObjectBase::getAssociatedClassLoaders()
 {
-  return associated_class_loaders_;
+  return getLibraryOwners(associated_library_path_);
+}
+
+InstancePool & AbstractMetaObjectBase::getInstancePool()
+{
+  return instance_pool_;
+}
+
+void AbstractMetaObjectBase::trimInstancePool()
+{
+}
+
+InstancePool::InstancePool()
+: hits_(0), misses_(0)
+{
+}
+
+InstancePool::~InstancePool()
+{
+  for (const Block & block : idle_) {
+    assert(nullptr == block.object);
+    ::operator delete(block.storage);
+  }
+}
+
+bool InstancePool::acquire(Block & block)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (idle_.empty()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  block = idle_.back();
+  idle_.pop_back();
+  return true;
+}
+
+void InstancePool::release(const Block & block)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  idle_.push_back(block);
+}
+
+std::vector<InstancePool::Block> InstancePool::releaseAll()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  std::vector<Block> blocks;
+  blocks.swap(idle_);
+  return blocks;
+}
+
+InstancePool::Statistics InstancePool::getStatistics()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  Statistics statistics;
+  statistics.hits = hits_;
+  statistics.misses = misses_;
+  statistics.idle = idle_.size();
+  return statistics;
 }
 
 }  // namespace impl
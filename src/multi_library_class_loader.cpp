@@ -29,25 +29,183 @@
 
 #include "class_loader/multi_library_class_loader.hpp"
 
+#ifdef __linux__
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace class_loader
 {
 
+namespace
+{
+
+std::int64_t steadyClockNanoseconds()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Gets the size of the pages the loadable segments of a library that is open map, 0 if it is not open or that cannot be determined on this platform
+ */
+std::size_t getMappedLibrarySize(const std::string & library_path)
+{
+#ifdef __linux__
+  // Resolves the path the way the library was opened, without opening it if it is not
+  void * handle = dlopen(library_path.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  if (nullptr == handle) {
+    return 0;
+  }
+  struct MappedSize
+  {
+    ElfW(Addr) base_address;
+    std::size_t size;
+  } mapped = {0, 0};
+  struct link_map * library = nullptr;
+  if (0 == dlinfo(handle, RTLD_DI_LINKMAP, &library) && nullptr != library) {
+    mapped.base_address = library->l_addr;
+    dl_iterate_phdr(
+      [](struct dl_phdr_info * info, size_t, void * data) -> int {
+        MappedSize * mapped = static_cast<MappedSize *>(data);
+        if (info->dlpi_addr != mapped->base_address) {
+          return 0;
+        }
+        const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        for (ElfW(Half) c = 0; c < info->dlpi_phnum; ++c) {
+          const ElfW(Phdr) & segment = info->dlpi_phdr[c];
+          if (PT_LOAD == segment.p_type) {
+            const std::size_t begin = segment.p_vaddr & ~(page_size - 1);
+            const std::size_t end =
+              (segment.p_vaddr + segment.p_memsz + page_size - 1) & ~(page_size - 1);
+            mapped->size += end - begin;
+          }
+        }
+        return 1;
+      }, &mapped);
+  }
+  dlclose(handle);
+  return mapped.size;
+#else
+  (void)library_path;
+  return 0;
+#endif
+}
+
+/**
+ * @brief Registers for a notification when tasks stall on memory, @see waitForMemoryPressure()
+ * @return The file descriptor to wait on, -1 if that is not supported
+ */
+int openMemoryPressureTrigger()
+{
+#ifdef __linux__
+  int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  // Some task stalled on memory for 150ms within 2s, the shortest window unprivileged processes
+  // may use
+  const char trigger[] = "some 150000 2000000";
+  if (write(fd, trigger, sizeof(trigger)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * @brief Waits for a memory pressure notification for up to timeout
+ * @return true if there was one
+ */
+bool waitForMemoryPressure(int fd, std::chrono::milliseconds timeout)
+{
+#ifdef __linux__
+  struct pollfd trigger;
+  std::memset(&trigger, 0, sizeof(trigger));
+  trigger.fd = fd;
+  trigger.events = POLLPRI;
+  return poll(&trigger, 1, static_cast<int>(timeout.count())) > 0 && (trigger.revents & POLLPRI);
+#else
+  (void)fd;
+  std::this_thread::sleep_for(timeout);
+  return false;
+#endif
+}
+
+void closeMemoryPressureTrigger(int fd)
+{
+#ifdef __linux__
+  close(fd);
+#else
+  (void)fd;
+#endif
+}
+
+/**
+ * @brief Gets the message of an exception that may not derive from std::exception
+ */
+std::string describeException(const std::exception_ptr & error)
+{
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception & e) {
+    return e.what();
+  } catch (...) {
+    return "unknown exception";
+  }
+}
+
+}  // namespace
+
 MultiLibraryClassLoader::MultiLibraryClassLoader(bool enable_ondemand_loadunload)
-: enable_ondemand_loadunload_(enable_ondemand_loadunload)
+: enable_ondemand_loadunload_(enable_ondemand_loadunload),
+  memory_budget_(0),
+  react_to_memory_pressure_(false),
+  eviction_requested_(false),
+  stop_eviction_(false),
+  eviction_statistics_()
 {
 }
 
 MultiLibraryClassLoader::~MultiLibraryClassLoader()
 {
+  // The loads still in progress refer to this object
+  while (waitForAsyncLoads()) {
+  }
+  {
+    boost::mutex::scoped_lock lock(eviction_mutex_);
+    stop_eviction_ = true;
+  }
+  eviction_condition_.notify_all();
+  if (eviction_thread_.joinable()) {
+    eviction_thread_.join();
+  }
   shutdownAllClassLoaders();
 }
 
 std::vector<std::string> MultiLibraryClassLoader::getRegisteredLibraries()
 {
+  boost::shared_lock<boost::shared_mutex> lock(loader_mutex_);
   std::vector<std::string> libraries;
   for (auto & it : active_class_loaders_) {
     if (it.second != nullptr) {
@@ -65,6 +223,44 @@ ClassLoader * MultiLibraryClassLoader::getClassLoaderForLibrary(const std::strin
   } else {return nullptr;}
 }
 
+ClassLoader * MultiLibraryClassLoader::lockClassLoaderForLibrary(
+  const std::string & library_path, boost::shared_lock<boost::shared_mutex> & lock)
+{
+  std::shared_future<void> async_load;
+  {
+    boost::mutex::scoped_lock async_loads_lock(async_loads_mutex_);
+    std::map<LibraryPath, std::shared_future<void>>::iterator itr =
+      async_loads_.find(library_path);
+    if (itr != async_loads_.end()) {
+      async_load = itr->second;
+    }
+  }
+  if (async_load.valid()) {
+    async_load.wait();
+  }
+  lock.lock();
+  ClassLoader * loader = getClassLoaderForLibrary(library_path);
+  if (nullptr != loader) {
+    noteLibraryUse(loader);
+  }
+  return loader;
+}
+
+bool MultiLibraryClassLoader::waitForAsyncLoads()
+{
+  std::vector<std::shared_future<void>> async_loads;
+  {
+    boost::mutex::scoped_lock lock(async_loads_mutex_);
+    for (auto & async_load : async_loads_) {
+      async_loads.push_back(async_load.second);
+    }
+  }
+  for (auto & async_load : async_loads) {
+    async_load.wait();
+  }
+  return !async_loads.empty();
+}
+
 ClassLoaderVector MultiLibraryClassLoader::getAllAvailableClassLoaders()
 {
   ClassLoaderVector loaders;
@@ -76,21 +272,143 @@ ClassLoaderVector MultiLibraryClassLoader::getAllAvailableClassLoaders()
 
 bool MultiLibraryClassLoader::isLibraryAvailable(const std::string & library_name)
 {
+  boost::shared_lock<boost::shared_mutex> lock(loader_mutex_);
   return getClassLoaderForLibrary(library_name) != nullptr;
 }
 
 void MultiLibraryClassLoader::loadLibrary(const std::string & library_path)
 {
-  if (!isLibraryAvailable(library_path)) {
-    active_class_loaders_[library_path] =
-      new class_loader::ClassLoader(library_path, isOnDemandLoadUnloadEnabled());
+  bindLibrary(library_path, false);
+}
+
+void MultiLibraryClassLoader::bindLibrary(const std::string & library_path, bool open_now)
+{
+  if (isLibraryAvailable(library_path)) {
+    return;
+  }
+
+  // Open the library without holding the lock so that it does not stall instance creation
+  ClassLoader * loader = new class_loader::ClassLoader(library_path, isOnDemandLoadUnloadEnabled());
+  if (open_now && isOnDemandLoadUnloadEnabled()) {
+    // The library is unloaded again on demand once the last instance created from it is gone
+    try {
+      loader->loadLibrary();
+    } catch (...) {
+      delete loader;
+      throw;
+    }
+  }
+  {
+    boost::unique_lock<boost::shared_mutex> lock(loader_mutex_);
+    ClassLoader * & active_loader = active_class_loaders_[library_path];
+    if (nullptr == active_loader) {
+      active_loader = loader;
+      library_usage_[loader].last_used.store(steadyClockNanoseconds());
+      loader = nullptr;
+      class_loader_index_.clear();
+    }
+  }
+  if (nullptr == loader) {
+    requestEviction();
   }
+  // Another thread bound the library in the meantime
+  delete loader;
 }
 
-void MultiLibraryClassLoader::shutdownAllClassLoaders()
+std::vector<LibraryLoadResult> MultiLibraryClassLoader::loadLibraries(
+  const std::vector<std::string> & library_paths, std::size_t parallelism)
+{
+  std::vector<LibraryLoadResult> results(library_paths.size());
+  std::atomic<std::size_t> next_library(0);
+  auto load_libraries = [&]() {
+      // Each worker publishes the factories of the libraries it loaded once it is done
+      impl::FactoryRegistryPublishBatch publish_batch;
+      for (std::size_t c = next_library++; c < library_paths.size(); c = next_library++) {
+        LibraryLoadResult & result = results[c];
+        result.library_path = library_paths[c];
+        std::exception_ptr error;
+        try {
+          bindLibrary(library_paths[c], true);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        result.loaded = !error;
+        if (error) {
+          result.error = describeException(error);
+        }
+      }
+    };
+
+  if (0 == parallelism) {
+    parallelism = std::max(1u, std::thread::hardware_concurrency());
+  }
+  parallelism = std::min(parallelism, library_paths.size());
+
+  // The calling thread is one of the workers
+  std::vector<std::thread> workers;
+  for (std::size_t c = 1; c < parallelism; ++c) {
+    workers.emplace_back(load_libraries);
+  }
+  load_libraries();
+  for (auto & worker : workers) {
+    worker.join();
+  }
+  return results;
+}
+
+std::shared_future<void> MultiLibraryClassLoader::loadLibraryAsync(
+  const std::string & library_path, const LoadExecutor & executor)
 {
-  std::vector<std::string> available_libraries = getRegisteredLibraries();
+  std::shared_ptr<std::promise<void>> loaded = std::make_shared<std::promise<void>>();
+  std::shared_future<void> future = loaded->get_future().share();
+  if (isLibraryAvailable(library_path)) {
+    loaded->set_value();
+    return future;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(async_loads_mutex_);
+    std::shared_future<void> & async_load = async_loads_[library_path];
+    if (async_load.valid()) {
+      return async_load;
+    }
+    async_load = future;
+  }
+
+  auto load = [this, library_path, loaded]() {
+      std::exception_ptr error;
+      try {
+        loadLibrary(library_path);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      {
+        boost::mutex::scoped_lock lock(async_loads_mutex_);
+        async_loads_.erase(library_path);
+      }
+      // Nothing may touch this object from here on, the destructor only waits for the future
+      if (error) {
+        loaded->set_exception(error);
+      } else {
+        loaded->set_value();
+      }
+    };
+  try {
+    if (executor) {
+      executor(load);
+    } else {
+      makeThreadLoadExecutor()(load);
+    }
+  } catch (...) {
+    boost::mutex::scoped_lock lock(async_loads_mutex_);
+    async_loads_.erase(library_path);
+    throw;
+  }
+  return future;
+}
 
+void MultiLibraryClassLoader::shutdownAllClassLoaders()
+{
   for (auto & library_path : getRegisteredLibraries()) {
     unloadLibrary(library_path);
   }
@@ -98,16 +416,235 @@ void MultiLibraryClassLoader::shutdownAllClassLoaders()
 
 int MultiLibraryClassLoader::unloadLibrary(const std::string & library_path)
 {
+  boost::unique_lock<boost::shared_mutex> lock(loader_mutex_);
   int remaining_unloads = 0;
   LibraryToClassLoaderMap::iterator itr = active_class_loaders_.find(library_path);
   if (itr != active_class_loaders_.end()) {
     ClassLoader * loader = itr->second;
+    // Also holds for an evicted library, which is not loaded any more
     if (0 == (remaining_unloads = loader->unloadLibrary())) {
       delete (loader);
       active_class_loaders_.erase(itr);
+      library_usage_.erase(loader);
+      class_loader_index_.clear();
     }
   }
   return remaining_unloads;
 }
 
+void MultiLibraryClassLoader::setMemoryBudget(
+  std::size_t budget_bytes, bool react_to_memory_pressure)
+{
+  memory_budget_.store(budget_bytes);
+  react_to_memory_pressure_.store(react_to_memory_pressure);
+  {
+    boost::mutex::scoped_lock lock(eviction_mutex_);
+    if (!eviction_thread_.joinable()) {
+      eviction_thread_ = std::thread(&MultiLibraryClassLoader::runEvictionThread, this);
+    }
+  }
+  requestEviction();
+}
+
+std::size_t MultiLibraryClassLoader::enforceMemoryBudget()
+{
+  return evictLibraries(false);
+}
+
+LibraryEvictionStatistics MultiLibraryClassLoader::getEvictionStatistics()
+{
+  boost::mutex::scoped_lock lock(eviction_statistics_mutex_);
+  return eviction_statistics_;
+}
+
+void MultiLibraryClassLoader::noteLibraryUse(ClassLoader * loader)
+{
+  std::unordered_map<const ClassLoader *, LibraryUsage>::iterator itr =
+    library_usage_.find(loader);
+  if (itr == library_usage_.end()) {
+    return;
+  }
+  LibraryUsage & usage = itr->second;
+  // Only worth writing to the shared cache line if there is something to evict
+  if (0 != memory_budget_.load(std::memory_order_relaxed) ||
+    react_to_memory_pressure_.load(std::memory_order_relaxed))
+  {
+    usage.last_used.store(steadyClockNanoseconds(), std::memory_order_relaxed);
+  }
+  if (!usage.evicted.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // Waits for an eviction in progress
+  boost::mutex::scoped_lock eviction_lock(usage.eviction_mutex);
+  if (!usage.evicted.load()) {
+    return;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  loader->loadLibraryIfNotLoaded();
+  std::chrono::nanoseconds reload_time = std::chrono::steady_clock::now() - start;
+  usage.evicted_classes.clear();
+  usage.evicted.store(false);
+  eviction_lock.unlock();
+  CONSOLE_BRIDGE_logDebug(
+    "class_loader::MultiLibraryClassLoader: Loaded evicted library %s again in %lld us.",
+    loader->getLibraryPath().c_str(),
+    static_cast<long long>(reload_time.count() / 1000));  // NOLINT(runtime/int)
+  {
+    boost::mutex::scoped_lock lock(eviction_statistics_mutex_);
+    ++eviction_statistics_.reloads;
+    eviction_statistics_.total_reload_time += reload_time;
+    eviction_statistics_.max_reload_time =
+      std::max(eviction_statistics_.max_reload_time, reload_time);
+  }
+  requestEviction();
+}
+
+void MultiLibraryClassLoader::requestEviction()
+{
+  {
+    boost::mutex::scoped_lock lock(eviction_mutex_);
+    if (!eviction_thread_.joinable()) {
+      return;
+    }
+    eviction_requested_ = true;
+  }
+  eviction_condition_.notify_all();
+}
+
+std::size_t MultiLibraryClassLoader::evictLibraries(bool under_memory_pressure)
+{
+  struct Candidate
+  {
+    ClassLoader * loader;
+    LibraryUsage * usage;
+    std::int64_t last_used;
+    std::size_t mapped_bytes;
+  };
+
+  // Measured before taking the lock, as that asks the dynamic linker about every library. One
+  // loaded in the meantime counts as 0 bytes until the eviction it requests.
+  std::unordered_map<std::string, std::size_t> library_sizes;
+  for (auto & library_path : getRegisteredLibraries()) {
+    library_sizes[library_path] = getMappedLibrarySize(library_path);
+  }
+
+  const std::size_t budget = memory_budget_.load();
+  std::size_t evictions = 0;
+  std::size_t mapped_bytes = 0;
+  {
+    // Shared, ClassLoaders are only removed with loader_mutex_ held exclusively
+    boost::shared_lock<boost::shared_mutex> lock(loader_mutex_);
+    std::vector<Candidate> candidates;
+    for (auto & it : active_class_loaders_) {
+      ClassLoader * loader = it.second;
+      LibraryUsage & usage = library_usage_.at(loader);
+      if (!loader->isLibraryLoaded()) {
+        continue;
+      }
+      Candidate candidate = {loader, &usage, 0, library_sizes[it.first]};
+      candidate.last_used = candidate.usage->last_used.load();
+      mapped_bytes += candidate.mapped_bytes;
+      candidates.push_back(candidate);
+    }
+
+    if (under_memory_pressure || (0 != budget && mapped_bytes > budget)) {
+      std::sort(candidates.begin(), candidates.end(),
+        [](const Candidate & lhs, const Candidate & rhs) {return lhs.last_used < rhs.last_used;});
+      for (auto & candidate : candidates) {
+        if (!under_memory_pressure && mapped_bytes <= budget) {
+          break;
+        }
+        if (!evictLibrary(candidate.loader, *candidate.usage)) {
+          continue;
+        }
+        CONSOLE_BRIDGE_logDebug(
+          "class_loader::MultiLibraryClassLoader: Evicted library %s, which mapped %zu bytes.",
+          candidate.loader->getLibraryPath().c_str(), candidate.mapped_bytes);
+        mapped_bytes -= candidate.mapped_bytes;
+        ++evictions;
+      }
+    }
+  }
+
+  boost::mutex::scoped_lock lock(eviction_statistics_mutex_);
+  eviction_statistics_.evictions += evictions;
+  eviction_statistics_.mapped_bytes = mapped_bytes;
+  return evictions;
+}
+
+bool MultiLibraryClassLoader::evictLibrary(ClassLoader * loader, LibraryUsage & usage)
+{
+  // The library may be marked evicted still if an instance creation that raced with the last
+  // eviction loaded it again
+  boost::mutex::scoped_lock eviction_lock(usage.eviction_mutex);
+  if (!loader->isLibraryLoaded()) {
+    return false;
+  }
+  // Taken while the factories are still registered, so the index can list the classes without
+  // loading the library again
+  std::map<std::string, std::vector<std::string>> classes;
+  for (auto & owned_class : impl::getOwnedClassesOfAllBases(loader)) {
+    classes[owned_class.first].push_back(owned_class.second);
+  }
+  // Instances of the library created from now on wait in noteLibraryUse() and load it again. One
+  // that got past it before still loads the library again by itself once the unload is done.
+  usage.evicted.store(true);
+  if (!loader->unloadLibraryIfUnused()) {
+    usage.evicted.store(false);
+    return false;
+  }
+  usage.evicted_classes.swap(classes);
+  return true;
+}
+
+void MultiLibraryClassLoader::runEvictionThread()
+{
+  int memory_pressure_fd = -1;
+  for (;; ) {
+    if (react_to_memory_pressure_.load() && memory_pressure_fd < 0) {
+      memory_pressure_fd = openMemoryPressureTrigger();
+      if (memory_pressure_fd < 0) {
+        CONSOLE_BRIDGE_logWarn("%s",
+          "class_loader::MultiLibraryClassLoader: "
+          "Cannot watch for memory pressure as /proc/pressure/memory is not available, "
+          "libraries are only evicted to stay within the memory budget.");
+        react_to_memory_pressure_.store(false);
+      }
+    } else if (!react_to_memory_pressure_.load() && memory_pressure_fd >= 0) {
+      closeMemoryPressureTrigger(memory_pressure_fd);
+      memory_pressure_fd = -1;
+    }
+
+    // The pressure trigger cannot be waited on together with the condition, so poll it with a
+    // timeout short enough for requests and shutting down
+    const bool under_memory_pressure = memory_pressure_fd >= 0 &&
+      waitForMemoryPressure(memory_pressure_fd, std::chrono::milliseconds(100));
+    {
+      boost::mutex::scoped_lock lock(eviction_mutex_);
+      if (memory_pressure_fd < 0) {
+        while (!eviction_requested_ && !stop_eviction_) {
+          eviction_condition_.wait(lock);
+        }
+      }
+      if (stop_eviction_) {
+        break;
+      }
+      if (!eviction_requested_ && !under_memory_pressure) {
+        continue;
+      }
+      eviction_requested_ = false;
+    }
+
+    if (under_memory_pressure) {
+      boost::mutex::scoped_lock lock(eviction_statistics_mutex_);
+      ++eviction_statistics_.memory_pressure_events;
+    }
+    evictLibraries(under_memory_pressure);
+  }
+  if (memory_pressure_fd >= 0) {
+    closeMemoryPressureTrigger(memory_pressure_fd);
+  }
+}
+
 }  // namespace class_loader
@@ -0,0 +1,96 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BENCHMARK_HPP_
+#define BENCHMARK_HPP_
+
+// Timing helpers shared by the benchmarks
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Calls function(c) for c from 0 to iterations - 1
+ * @return The average time a call took, in nanoseconds
+ */
+template<typename Function>
+double nanosecondsPerCall(std::size_t iterations, Function function)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t c = 0; c < iterations; ++c) {
+    function(c);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return static_cast<double>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+}
+
+/**
+ * @brief Runs operation on thread_count threads for duration
+ * @return The total number of operations per second completed by all threads
+ */
+inline double operationsPerSecond(
+  std::size_t thread_count, std::chrono::milliseconds duration,
+  const std::function<void()> & operation)
+{
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+  std::atomic<std::size_t> total(0);
+  std::vector<std::thread> threads;
+  for (std::size_t c = 0; c < thread_count; ++c) {
+    threads.emplace_back([&]() {
+        while (!start.load()) {
+          std::this_thread::yield();
+        }
+        std::size_t count = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          operation();
+          ++count;
+        }
+        total += count;
+      });
+  }
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true);
+  std::this_thread::sleep_for(duration);
+  stop.store(true);
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+  return static_cast<double>(total.load()) / elapsed.count();
+}
+
+#endif  // BENCHMARK_HPP_
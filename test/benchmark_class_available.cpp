@@ -0,0 +1,112 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compares checking for and enumerating the available classes through the vector returned by
+// getAvailableClasses() with the direct registry probe and the visitor API, with 10000 classes
+// registered. The registry is filled in-process like in benchmark_registry.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "class_loader/class_loader.hpp"
+
+#include "./base.hpp"
+#include "./benchmark.hpp"
+
+namespace
+{
+
+const char BENCHMARK_LIBRARY[] = "libclass_loader_benchmark_class_available.so";
+
+class BenchmarkPlugin : public Base
+{
+public:
+  virtual void saySomething() {}
+};
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::size_t classes = 10000;
+  std::size_t iterations = 200;
+  if (argc > 1) {
+    classes = std::stoul(argv[1]);
+  }
+  if (argc > 2) {
+    iterations = std::stoul(argv[2]);
+  }
+
+  // The loader is never asked to open BENCHMARK_LIBRARY, it only serves as the owner of the
+  // factories registered below.
+  class_loader::ClassLoader loader(BENCHMARK_LIBRARY, true);
+  class_loader::impl::setCurrentlyActiveClassLoader(&loader);
+  class_loader::impl::setCurrentlyLoadingLibraryName(BENCHMARK_LIBRARY);
+  std::vector<std::string> names;
+  for (std::size_t c = 0; c < classes; ++c) {
+    names.push_back("benchmark_namespace::BenchmarkPlugin" + std::to_string(c));
+    class_loader::impl::registerPlugin<BenchmarkPlugin, Base>(names.back(), "Base");
+  }
+  class_loader::impl::setCurrentlyLoadingLibraryName("");
+  class_loader::impl::setCurrentlyActiveClassLoader(nullptr);
+  class_loader::impl::publishFactoryRegistrySnapshot();
+
+  volatile std::size_t sink = 0;
+  double vector_find_ns = nanosecondsPerCall(iterations, [&](std::size_t c) {
+        std::vector<std::string> available = loader.getAvailableClasses<Base>();
+        const std::string & name = names[(c * 7919) % classes];
+        sink = sink + (std::find(available.begin(), available.end(), name) != available.end());
+      });
+  double probe_ns = nanosecondsPerCall(iterations * 1000, [&](std::size_t c) {
+        sink = sink + loader.isClassAvailable<Base>(names[(c * 7919) % classes]);
+      });
+  double vector_walk_ns = nanosecondsPerCall(iterations, [&](std::size_t) {
+        for (const std::string & name : loader.getAvailableClasses<Base>()) {
+          sink = sink + name.size();
+        }
+      });
+  double visitor_walk_ns = nanosecondsPerCall(iterations, [&](std::size_t) {
+        loader.forEachAvailableClass<Base>([&](const std::string & name) {
+          sink = sink + name.size();
+        });
+      });
+
+  printf("%zu classes registered\n", classes);
+  printf("%-48s %15.1f ns\n", "isClassAvailable via getAvailableClasses + find", vector_find_ns);
+  printf("%-48s %15.1f ns\n", "isClassAvailable (registry probe)", probe_ns);
+  printf("%-48s %15.1f ns\n", "walk getAvailableClasses", vector_walk_ns);
+  printf("%-48s %15.1f ns\n", "walk forEachAvailableClass", visitor_walk_ns);
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures how plugin instantiation throughput scales with the number of threads creating
+// plugins from the same ClassLoader concurrently.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "class_loader/class_loader.hpp"
+
+#include "./base.hpp"
+#include "./benchmark.hpp"
+
+const std::string LIBRARY_1 = class_loader::systemLibraryFormat("class_loader_TestPlugins1");  // NOLINT
+
+int main(int argc, char ** argv)
+{
+  std::chrono::milliseconds duration(500);
+  if (argc > 1) {
+    duration = std::chrono::milliseconds(std::stoul(argv[1]));
+  }
+
+  std::vector<std::size_t> thread_counts;
+  std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t count = 1; count < max_threads; count *= 2) {
+    thread_counts.push_back(count);
+  }
+  thread_counts.push_back(max_threads);
+
+  class_loader::ClassLoader loader(LIBRARY_1, false);
+
+  class_loader::ClassLoader::Factory<Base> factory = loader.getFactory<Base>("Cat");
+
+  printf("%8s %24s %24s %24s %24s %24s\n", "threads", "impl::createInstance",
+    "createUniqueInstance", "createSharedInstance", "Factory::createUnique",
+    "getAvailableClasses");
+  for (std::size_t thread_count : thread_counts) {
+    double create_rate = operationsPerSecond(thread_count, duration, [&loader]() {
+          delete class_loader::impl::createInstance<Base>("Cat", &loader);
+        });
+    double create_unique_rate = operationsPerSecond(thread_count, duration, [&loader]() {
+          loader.createUniqueInstance<Base>("Cat");
+        });
+    double create_shared_rate = operationsPerSecond(thread_count, duration, [&loader]() {
+          loader.createSharedInstance<Base>("Cat");
+        });
+    double factory_rate = operationsPerSecond(thread_count, duration, [&factory]() {
+          factory.createUnique();
+        });
+    double available_rate = operationsPerSecond(thread_count, duration, [&loader]() {
+          loader.getAvailableClasses<Base>();
+        });
+    printf("%8zu %20.0f /s %20.0f /s %20.0f /s %20.0f /s %20.0f /s\n", thread_count,
+      create_rate, create_unique_rate, create_shared_rate, factory_rate, available_rate);
+  }
+
+  return 0;
+}
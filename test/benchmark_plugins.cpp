@@ -0,0 +1,73 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// A synthetic plugin library for the startup benchmark. It is compiled once per library with a
+// different BENCHMARK_PLUGIN_INDEX so that the class names of every library are unique.
+
+#include "class_loader/class_loader.hpp"
+
+#include "./base.hpp"
+
+#ifndef BENCHMARK_PLUGIN_INDEX
+#error BENCHMARK_PLUGIN_INDEX must be defined
+#endif
+
+#define BENCHMARK_CONCATENATE_(a, b) a ## b
+#define BENCHMARK_CONCATENATE(a, b) BENCHMARK_CONCATENATE_(a, b)
+#define BENCHMARK_NAMESPACE BENCHMARK_CONCATENATE(benchmark_plugins_, BENCHMARK_PLUGIN_INDEX)
+
+#define BENCHMARK_PLUGIN(Name) \
+  namespace BENCHMARK_NAMESPACE \
+  { \
+  class Name : public Base \
+  { \
+public: \
+    virtual void saySomething() {} \
+  }; \
+  } \
+  CLASS_LOADER_REGISTER_CLASS(BENCHMARK_NAMESPACE::Name, Base)
+
+BENCHMARK_PLUGIN(Plugin0)
+BENCHMARK_PLUGIN(Plugin1)
+BENCHMARK_PLUGIN(Plugin2)
+BENCHMARK_PLUGIN(Plugin3)
+BENCHMARK_PLUGIN(Plugin4)
+BENCHMARK_PLUGIN(Plugin5)
+BENCHMARK_PLUGIN(Plugin6)
+BENCHMARK_PLUGIN(Plugin7)
+BENCHMARK_PLUGIN(Plugin8)
+BENCHMARK_PLUGIN(Plugin9)
+BENCHMARK_PLUGIN(Plugin10)
+BENCHMARK_PLUGIN(Plugin11)
+BENCHMARK_PLUGIN(Plugin12)
+BENCHMARK_PLUGIN(Plugin13)
+BENCHMARK_PLUGIN(Plugin14)
+BENCHMARK_PLUGIN(Plugin15)
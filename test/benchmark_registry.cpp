@@ -0,0 +1,111 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures the cost of looking up and instantiating a plugin as a function of the number of
+// classes registered in the process. The registry is filled in-process through the same entry
+// point that CLASS_LOADER_REGISTER_CLASS uses, so no plugin libraries are needed.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "class_loader/class_loader.hpp"
+
+#include "./base.hpp"
+#include "./benchmark.hpp"
+
+namespace
+{
+
+const char BENCHMARK_LIBRARY[] = "libclass_loader_benchmark_registry.so";
+
+class BenchmarkPlugin : public Base
+{
+public:
+  virtual void saySomething() {}
+};
+
+std::string className(std::size_t index)
+{
+  return "benchmark_namespace::BenchmarkPlugin" + std::to_string(index);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::size_t iterations = 1000000;
+  if (argc > 1) {
+    iterations = std::stoul(argv[1]);
+  }
+
+  // The loader is never asked to open BENCHMARK_LIBRARY, it only serves as the owner of the
+  // factories registered below.
+  class_loader::ClassLoader loader(BENCHMARK_LIBRARY, true);
+  class_loader::impl::setCurrentlyActiveClassLoader(&loader);
+  class_loader::impl::setCurrentlyLoadingLibraryName(BENCHMARK_LIBRARY);
+
+  std::map<std::string, class_loader::impl::AbstractMetaObjectBase *> reference_map;
+  std::vector<std::string> names;
+  std::size_t registered = 0;
+  volatile std::size_t sink = 0;
+
+  printf("%10s %18s %18s %18s\n", "classes", "std::map find", "FactoryMap find", "createInstance");
+  for (std::size_t registry_size : {10, 100, 1000, 10000, 100000}) {
+    for (; registered < registry_size; ++registered) {
+      names.push_back(className(registered));
+      class_loader::impl::registerPlugin<BenchmarkPlugin, Base>(names.back(), "Base");
+      reference_map[names.back()] =
+        class_loader::impl::getFactoryMapForBaseClass<Base>()[names.back()];
+    }
+
+    double map_ns = nanosecondsPerCall(iterations, [&](std::size_t c) {
+        sink = sink + reference_map.count(names[c % registry_size]);
+      });
+    class_loader::impl::FactoryMap & factory_map =
+      class_loader::impl::getFactoryMapForBaseClass<Base>();
+    double hash_ns = nanosecondsPerCall(iterations, [&](std::size_t c) {
+        sink = sink + factory_map.count(names[c % registry_size]);
+      });
+    double create_ns = nanosecondsPerCall(iterations, [&](std::size_t c) {
+        delete class_loader::impl::createInstance<Base>(names[c % registry_size], &loader);
+      });
+
+    printf("%10zu %15.1f ns %15.1f ns %15.1f ns\n", registry_size, map_ns, hash_ns, create_ns);
+  }
+
+  class_loader::impl::setCurrentlyLoadingLibraryName("");
+  class_loader::impl::setCurrentlyActiveClassLoader(nullptr);
+  return 0;
+}
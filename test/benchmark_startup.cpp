@@ -0,0 +1,123 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compares the wall clock time it takes to load BENCHMARK_PLUGIN_LIBRARY_COUNT synthetic plugin
+// libraries with one MultiLibraryClassLoader::loadLibrary() call after the other against loading
+// them in one MultiLibraryClassLoader::loadLibraries() batch.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "class_loader/multi_library_class_loader.hpp"
+
+#include "./base.hpp"
+
+#ifndef BENCHMARK_PLUGIN_LIBRARY_COUNT
+#error BENCHMARK_PLUGIN_LIBRARY_COUNT must be defined
+#endif
+
+namespace
+{
+
+/**
+ * @brief Runs load on a new MultiLibraryClassLoader, repetitions times
+ * @return The median wall clock time of a run in milliseconds, not counting unloading
+ */
+double medianMilliseconds(
+  std::size_t repetitions,
+  const std::function<void(class_loader::MultiLibraryClassLoader &)> & load)
+{
+  std::vector<double> times;
+  for (std::size_t c = 0; c < repetitions; ++c) {
+    class_loader::MultiLibraryClassLoader loader(false);
+    auto begin = std::chrono::steady_clock::now();
+    load(loader);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    times.push_back(elapsed.count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::size_t repetitions = 11;
+  if (argc > 1) {
+    repetitions = std::stoul(argv[1]);
+  }
+
+  std::vector<std::string> library_paths;
+  for (std::size_t c = 1; c <= BENCHMARK_PLUGIN_LIBRARY_COUNT; ++c) {
+    library_paths.push_back(class_loader::systemLibraryFormat(
+        "class_loader_BenchmarkPlugins" + std::to_string(c)));
+  }
+
+  double serial_time = medianMilliseconds(repetitions,
+      [&library_paths](class_loader::MultiLibraryClassLoader & loader) {
+        for (const std::string & library_path : library_paths) {
+          loader.loadLibrary(library_path);
+        }
+      });
+  printf("%zu libraries, loadLibrary() one by one: %.2f ms\n", library_paths.size(), serial_time);
+
+  std::vector<std::size_t> parallelisms;
+  std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t count = 1; count < max_threads; count *= 2) {
+    parallelisms.push_back(count);
+  }
+  parallelisms.push_back(max_threads);
+
+  for (std::size_t parallelism : parallelisms) {
+    double batch_time = medianMilliseconds(repetitions,
+        [&library_paths, parallelism](class_loader::MultiLibraryClassLoader & loader) {
+          for (const class_loader::LibraryLoadResult & result :
+            loader.loadLibraries(library_paths, parallelism))
+          {
+            if (!result.loaded) {
+              fprintf(stderr, "Failed to load %s: %s\n", result.library_path.c_str(),
+                result.error.c_str());
+            }
+          }
+        });
+    printf("%zu libraries, loadLibraries() on %zu threads: %.2f ms\n", library_paths.size(),
+      parallelism, batch_time);
+  }
+
+  return 0;
+}
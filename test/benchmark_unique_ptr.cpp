@@ -0,0 +1,79 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2018, Open Source Robotics Foundation, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the copyright holders nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compares the size and the create/destroy cost of ClassLoader::UniquePtr, whose deleter only
+// holds the ClassLoader pointer, with a std::unique_ptr holding a type erased std::function
+// deleter.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "class_loader/class_loader.hpp"
+
+#include "./base.hpp"
+#include "./benchmark.hpp"
+
+const std::string LIBRARY_1 = class_loader::systemLibraryFormat("class_loader_TestPlugins1");  // NOLINT
+
+namespace
+{
+
+typedef std::unique_ptr<Base, std::function<void(Base *)>> FunctionPtr;
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::size_t iterations = 1000000;
+  if (argc > 1) {
+    iterations = std::stoul(argv[1]);
+  }
+
+  class_loader::ClassLoader loader(LIBRARY_1, false);
+  class_loader::ClassLoader::Factory<Base> factory = loader.getFactory<Base>("Cat");
+
+  double unique_ns = nanosecondsPerCall(iterations, [&factory](std::size_t) {
+        class_loader::ClassLoader::UniquePtr<Base> obj = factory.createUnique();
+      });
+  double function_ns = nanosecondsPerCall(iterations, [&factory](std::size_t) {
+        FunctionPtr obj = factory.createUnique();
+      });
+
+  printf("%-24s %8s %18s\n", "pointer type", "size", "create + destroy");
+  printf("%-24s %6zu B %15.1f ns\n",
+    "ClassLoader::UniquePtr", sizeof(class_loader::ClassLoader::UniquePtr<Base>), unique_ns);
+  printf("%-24s %6zu B %15.1f ns\n", "std::function deleter", sizeof(FunctionPtr), function_ns);
+  return 0;
+}
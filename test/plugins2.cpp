@@ -27,7 +27,11 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <iostream>
+#include <thread>
 
 #include "class_loader/class_loader.hpp"
 
@@ -57,8 +61,70 @@ public:
   virtual void saySomething() {std::cout << "Brains!!!" << std::endl;}
 };
 
+class Drone : public Base
+{
+public:
+  virtual void saySomething() {std::cout << "Bzzz" << std::endl;}
+
+  // Lets ClassLoader::createPooledInstance() hand out released drones again
+  void resetForReuse() {}
+};
+
+namespace
+{
+// Not a static local of an inline function, which would keep the library from being unloaded
+std::atomic<std::size_t> hoarder_allocations(0);
+}  // namespace
+
+class Hoarder : public Base
+{
+public:
+  virtual void saySomething() {std::cout << "Mine!" << std::endl;}
+
+  static void * operator new(std::size_t size)
+  {
+    ++hoarder_allocations;
+    return ::operator new(size);
+  }
+
+  static void operator delete(void * ptr) {::operator delete(ptr);}
+};
+
+// Lets tests see which instances were allocated by Hoarder::operator new
+extern "C" std::size_t hoarderAllocations() {return hoarder_allocations.load();}
+
+namespace
+{
+std::atomic<std::size_t> sloths_in_destructor(0);
+std::atomic<std::size_t> max_sloths_in_destructor(0);
+}  // namespace
+
+class Sloth : public Base
+{
+public:
+  // Stands in for destructors that free large buffers or join threads
+  virtual ~Sloth()
+  {
+    const std::size_t inside = ++sloths_in_destructor;
+    std::size_t max_inside = max_sloths_in_destructor.load();
+    while (max_inside < inside &&
+      !max_sloths_in_destructor.compare_exchange_weak(max_inside, inside))
+    {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    --sloths_in_destructor;
+  }
+  virtual void saySomething() {std::cout << "Zzz" << std::endl;}
+};
+
+// Lets tests see how many Sloth destructors ran at the same time
+extern "C" std::size_t slothMaxConcurrentDestructors() {return max_sloths_in_destructor.load();}
+
 
 CLASS_LOADER_REGISTER_CLASS(Robot, Base)
 CLASS_LOADER_REGISTER_CLASS(Alien, Base)
 CLASS_LOADER_REGISTER_CLASS(Monster, Base)
 CLASS_LOADER_REGISTER_CLASS(Zombie, Base)
+CLASS_LOADER_REGISTER_CLASS(Drone, Base)
+CLASS_LOADER_REGISTER_CLASS(Hoarder, Base)
+CLASS_LOADER_REGISTER_CLASS(Sloth, Base)
@@ -31,6 +31,7 @@
 #include <cstddef>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -269,6 +270,25 @@ TEST(ClassLoaderSharedPtrTest, loadRefCountingLazy) {
   FAIL() << "Did not throw exception as expected.\n";
 }
 
+TEST(ClassLoaderSharedPtrTest, weakPtrOutlivesLibrary) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  std::weak_ptr<Base> weak;
+  {
+    std::shared_ptr<Base> obj = loader1.createSharedInstance<Base>("Cat");
+    std::shared_ptr<Base> copy = obj;
+    weak = obj;
+    obj.reset();
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+    copy->saySomething();
+  }
+
+  // The object is gone and the library unloaded, only the block holding the control block remains
+  ASSERT_TRUE(weak.expired());
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+  weak.reset();
+}
+
 void testMultiClassLoader(bool lazy)
 {
   try {
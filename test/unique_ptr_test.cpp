@@ -37,6 +37,7 @@
 #include <cstddef>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -101,6 +102,24 @@ TEST(ClassLoaderUniquePtrTest, nonExistentPlugin) {
   FAIL() << "Did not throw exception as expected.\n";
 }
 
+TEST(ClassLoaderUniquePtrTest, compactDeleter) {
+  ASSERT_EQ(2 * sizeof(void *), sizeof(ClassLoader::UniquePtr<Base>));
+
+  ClassLoader loader1(LIBRARY_1, true);
+  {
+    // The type erased DeleterType can still be used
+    std::unique_ptr<Base, ClassLoader::DeleterType<Base>> obj =
+      loader1.createUniqueInstance<Base>("Cat");
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+
+    Base * released = obj.release();
+    ClassLoader::UniquePtr<Base> other = loader1.createUniqueInstance<Base>("Dog");
+    other.get_deleter()(released);
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+  }
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+}
+
 void wait(int seconds)
 {
   std::this_thread::sleep_for(std::chrono::seconds(seconds));
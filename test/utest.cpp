@@ -27,12 +27,25 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef __linux__
+#include <dlfcn.h>
+#include <link.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "class_loader/class_loader.hpp"
@@ -129,6 +142,15 @@ TEST(ClassLoaderTest, nonExistentLibrary) {
   FAIL() << "Did not throw exception as expected.\n";
 }
 
+TEST(ClassLoaderTest, nonExistentLibraryOnDemand) {
+  class_loader::ClassLoader loader1("libDoesNotExist.so", true);
+  // The load error is reported, not the failure to unload what was never loaded
+  EXPECT_THROW(loader1.getFactory<Base>("Cat"), class_loader::LibraryLoadException);
+  EXPECT_THROW(loader1.createUniqueInstance<Base>("Cat"), class_loader::LibraryLoadException);
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  ASSERT_EQ(0, loader1.unloadLibrary());
+}
+
 class InvalidBase
 {
 };
@@ -195,6 +217,361 @@ TEST(ClassLoaderTest, threadSafety) {
   }
 }
 
+TEST(ClassLoaderTest, concurrentLazyLoadUnload) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  std::vector<std::thread> client_threads;
+  for (size_t c = 0; c < 8; c++) {
+    client_threads.emplace_back([&loader1]() {
+        // Every thread keeps dropping the last reference while others take new ones
+        for (size_t i = 0; i < 200; i++) {
+          loader1.createUniqueInstance<Base>("Cat");
+        }
+      });
+  }
+  for (auto & client_thread : client_threads) {
+    client_thread.join();
+  }
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+}
+
+TEST(ClassLoaderTest, concurrentLoadOfDistinctAndSameLibraries) {
+  for (size_t round = 0; round < 20; round++) {
+    std::vector<std::thread> client_threads;
+    for (size_t c = 0; c < 8; c++) {
+      client_threads.emplace_back([c]() {
+          // Factories must be attributed to the loader whose thread opened the library
+          bool first_library = (0 == c % 2);
+          class_loader::ClassLoader loader(first_library ? LIBRARY_1 : LIBRARY_2, false);
+          EXPECT_EQ(first_library, loader.isClassAvailable<Base>("Cat"));
+          EXPECT_EQ(!first_library, loader.isClassAvailable<Base>("Robot"));
+          loader.createUniqueInstance<Base>(first_library ? "Cat" : "Robot")->saySomething();
+        });
+    }
+    for (auto & client_thread : client_threads) {
+      client_thread.join();
+    }
+    ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+    ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_2));
+  }
+}
+
+TEST(ClassLoaderTest, concurrentLoadOfNonExistentLibrary) {
+  std::vector<std::thread> client_threads;
+  for (size_t c = 0; c < 8; c++) {
+    client_threads.emplace_back([]() {
+        EXPECT_THROW(
+          class_loader::ClassLoader loader("libDoesNotExist.so"),
+          class_loader::LibraryLoadException);
+      });
+  }
+  for (auto & client_thread : client_threads) {
+    client_thread.join();
+  }
+}
+
+TEST(ClassLoaderTest, loadLibraryAsync) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  loader1.loadLibraryAsync().get();
+  ASSERT_TRUE(loader1.isLibraryLoaded());
+  // The load does not pin the library, it is still unloaded on demand
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+
+  // Nor does it add a reference to a library that is loaded already
+  class_loader::ClassLoader loader2(LIBRARY_1, false);
+  loader2.loadLibraryAsync().get();
+  ASSERT_EQ(0, loader2.unloadLibrary());
+  ASSERT_FALSE(loader2.isLibraryLoaded());
+
+  std::vector<std::function<void()>> tasks;
+  class_loader::LoadExecutor deferred = [&tasks](const std::function<void()> & task) {
+      tasks.push_back(task);
+    };
+  std::shared_future<void> loaded = loader1.loadLibraryAsync(deferred);
+  // Asking again while the load is pending does not start another one
+  loader1.loadLibraryAsync(deferred);
+  ASSERT_EQ(1u, tasks.size());
+  tasks.front()();
+  loaded.get();
+  ASSERT_TRUE(loader1.isLibraryLoaded());
+  ASSERT_EQ(0, loader1.unloadLibrary());
+}
+
+TEST(ClassLoaderTest, unloadGracePeriod) {
+  {
+    // Long enough for the second instance to always be created within the grace period
+    class_loader::ClassLoader loader1(LIBRARY_1, true);
+    loader1.setUnloadGracePeriod(std::chrono::seconds(10));
+
+    loader1.createUniqueInstance<Base>("Cat")->saySomething();
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+    loader1.createUniqueInstance<Base>("Cat")->saySomething();
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+    EXPECT_EQ(1u, loader1.getUnloadStatistics().reloads_avoided);
+    EXPECT_EQ(0u, loader1.getUnloadStatistics().idle_unloads);
+  }
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  loader1.setUnloadGracePeriod(std::chrono::milliseconds(100));
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  for (size_t c = 0; c < 500 && loader1.isLibraryLoaded(); c++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+  EXPECT_EQ(1u, loader1.getUnloadStatistics().idle_unloads);
+
+  // The library is loaded on demand again after it was unloaded
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  EXPECT_EQ(0u, loader1.getUnloadStatistics().reloads_avoided);
+}
+
+TEST(ClassLoaderTest, asynchronousUnload) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  loader1.setAsynchronousUnload(true);
+
+  // Requesting the library again works whether or not the queued unload ran already
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  loader1.createUniqueInstance<Base>("Dog")->saySomething();
+  for (size_t c = 0; c < 500 && loader1.isLibraryLoaded(); c++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  class_loader::ClassLoader::UnloadStatistics statistics = loader1.getUnloadStatistics();
+  EXPECT_EQ(2u, statistics.idle_unloads + statistics.reloads_avoided);
+  EXPECT_EQ(0u, statistics.queue_full_unloads);
+
+  // Without room in the queue the library is unloaded right away
+  class_loader::ClassLoader::setUnloadQueueCapacity(0);
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  class_loader::ClassLoader::setUnloadQueueCapacity(256);
+  EXPECT_FALSE(loader1.isLibraryLoaded());
+  EXPECT_EQ(1u, loader1.getUnloadStatistics().queue_full_unloads);
+}
+
+TEST(ClassLoaderTest, deferredDestruction) {
+  const size_t destroyed_before =
+    class_loader::ClassLoader::getDeferredDestructionStatistics().destroyed;
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  loader1.createDeferredInstance<Base>("Cat")->saySomething();
+  loader1.getFactory<Base>("Dog").createDeferred()->saySomething();
+
+  // The reclamation thread destroys the objects and then unloads the library on demand
+  class_loader::ClassLoader::DeferredDestructionStatistics statistics =
+    class_loader::ClassLoader::getDeferredDestructionStatistics();
+  for (size_t c = 0; c < 500 && statistics.destroyed - destroyed_before < 2; c++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    statistics = class_loader::ClassLoader::getDeferredDestructionStatistics();
+  }
+  EXPECT_EQ(2u, statistics.destroyed - destroyed_before);
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  EXPECT_LE(1u, statistics.max_queue_depth);
+  EXPECT_LE(statistics.max_latency, statistics.total_latency);
+  EXPECT_LE(statistics.total_destruction_time, statistics.total_latency);
+
+  // A ClassLoader waits for its queued objects before it unloads the library
+  {
+    class_loader::ClassLoader loader2(LIBRARY_2, false);
+    loader2.createDeferredInstance<Base>("Robot")->saySomething();
+  }
+  EXPECT_EQ(
+    3u, class_loader::ClassLoader::getDeferredDestructionStatistics().destroyed - destroyed_before);
+}
+
+TEST(ClassLoaderTest, concurrentSlowDestructors) {
+  class_loader::ClassLoader loader1(LIBRARY_2, true);
+  const size_t thread_count = 8;
+  const size_t rounds = 10;
+
+  // Each Sloth takes 10ms to destroy. No lock is held meanwhile, so destructors on different
+  // threads overlap, and neither creating nor destroying other objects waits for them.
+  std::atomic<size_t> robots(0);
+  // Keeps the library loaded until the overlap was checked
+  class_loader::ClassLoader::UniquePtr<Base> robot = loader1.createUniqueInstance<Base>("Robot");
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < thread_count; c++) {
+    threads.emplace_back([&loader1, &robots, c]() {
+        for (size_t round = 0; round < rounds; round++) {
+          if (0 == c % 2) {
+            std::shared_ptr<Base> sloth = loader1.createSharedInstance<Base>("Sloth");
+            loader1.createUniqueInstance<Base>("Sloth").reset();
+          } else {
+            loader1.createUniqueInstance<Base>("Sloth").reset();
+            loader1.createUniqueInstance<Base>("Robot").reset();
+            ++robots;
+          }
+        }
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(thread_count / 2 * rounds, robots.load());
+#ifdef __linux__
+  void * handle = dlopen(LIBRARY_2.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  ASSERT_TRUE(nullptr != handle);
+  typedef std::size_t (* DestructorCount)();
+  DestructorCount max_concurrent_destructors =
+    reinterpret_cast<DestructorCount>(dlsym(handle, "slothMaxConcurrentDestructors"));
+  ASSERT_TRUE(nullptr != max_concurrent_destructors);
+  EXPECT_LE(2u, max_concurrent_destructors());
+  dlclose(handle);
+#endif
+
+  robot.reset();
+  // The last object to go unloaded the library on demand
+  EXPECT_FALSE(loader1.isLibraryLoaded());
+}
+
+TEST(ClassLoaderTest, cachedLoadedStateFollowsLibraryGeneration) {
+  class_loader::ClassLoader loader1(LIBRARY_1, false);
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  const std::uint64_t generation = class_loader::impl::getLibraryGeneration();
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  EXPECT_EQ(generation, class_loader::impl::getLibraryGeneration());
+
+  // Unloading invalidates the cached state, so creating loads the library again rather than
+  // using the closed one
+  loader1.unloadLibrary();
+  EXPECT_NE(generation, class_loader::impl::getLibraryGeneration());
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  loader1.createUniqueInstance<Base>("Cat")->saySomething();
+  EXPECT_TRUE(loader1.isLibraryLoaded());
+}
+
+#ifdef __linux__
+/**
+ * @brief Returns the resolved path of the file the dynamic linker opened for a loaded library
+ */
+std::string getLoadedLibraryFile(const std::string & library_path)
+{
+  void * handle = dlopen(library_path.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  if (nullptr == handle) {
+    return "";
+  }
+  struct link_map * map = nullptr;
+  std::string file;
+  if (0 == dlinfo(handle, RTLD_DI_LINKMAP, &map) && nullptr != map) {
+    // The name is relative when the library was found through a relative search path
+    char * real_path = realpath(map->l_name, nullptr);
+    if (nullptr != real_path) {
+      file = real_path;
+      free(real_path);
+    }
+  }
+  dlclose(handle);
+  return file;
+}
+
+TEST(ClassLoaderTest, aliasedPathsShareLibrary) {
+  std::string file;
+  {
+    class_loader::ClassLoader loader(LIBRARY_1, false);
+    file = getLoadedLibraryFile(LIBRARY_1);
+  }
+  ASSERT_FALSE(file.empty());
+  const std::string::size_type slash = file.rfind('/');
+  ASSERT_NE(std::string::npos, slash);
+  const std::string dotted_path = file.substr(0, slash) + "/." + file.substr(slash);
+
+  char link_directory[] = "/tmp/class_loader_aliasXXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(link_directory));
+  const std::string linked_path = std::string(link_directory) + "/" + LIBRARY_1;
+  ASSERT_EQ(0, symlink(file.c_str(), linked_path.c_str()));
+
+  const std::string canonical_path = class_loader::impl::getCanonicalLibraryPath(dotted_path);
+  EXPECT_EQ(canonical_path, class_loader::impl::getCanonicalLibraryPath(linked_path));
+  {
+    class_loader::ClassLoader dotted_loader(dotted_path, false);
+    class_loader::ClassLoader linked_loader(linked_path, false);
+    EXPECT_EQ(1u, class_loader::impl::getLoadedLibraryMap().count(canonical_path));
+    dotted_loader.createUniqueInstance<Base>("Cat")->saySomething();
+    linked_loader.createUniqueInstance<Base>("Cat")->saySomething();
+
+    // The library stays open while the other alias still uses it
+    dotted_loader.unloadLibrary();
+    EXPECT_TRUE(class_loader::impl::getAllLibrariesUsedByClassLoader(&dotted_loader).empty());
+    EXPECT_TRUE(class_loader::impl::isLibraryLoadedByAnybody(dotted_path));
+    linked_loader.createUniqueInstance<Base>("Cat")->saySomething();
+    // Reported by the path it was requested by, only tracked by the canonical one
+    EXPECT_EQ(linked_path, linked_loader.getLibraryPath());
+    EXPECT_EQ(canonical_path, linked_loader.getCanonicalLibraryPath());
+    EXPECT_EQ(
+      std::vector<std::string>(1, linked_path),
+      class_loader::impl::getAllLibrariesUsedByClassLoader(&linked_loader));
+  }
+  EXPECT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(linked_path));
+
+  // A link pointed at another library resolves to that one
+  std::string other_file;
+  {
+    class_loader::ClassLoader loader(LIBRARY_2, false);
+    other_file = getLoadedLibraryFile(LIBRARY_2);
+  }
+  ASSERT_FALSE(other_file.empty());
+  unlink(linked_path.c_str());
+  ASSERT_EQ(0, symlink(other_file.c_str(), linked_path.c_str()));
+  EXPECT_EQ(other_file, class_loader::impl::getCanonicalLibraryPath(linked_path));
+
+  unlink(linked_path.c_str());
+  rmdir(link_directory);
+}
+#endif
+
+TEST(ClassLoaderTest, graveyardStaysBoundedAcrossReloads) {
+  size_t buried = 0;
+  for (int i = 0; i < 20; ++i) {
+    {
+      class_loader::ClassLoader loader(LIBRARY_1, false);
+      loader.createUniqueInstance<Base>("Cat")->saySomething();
+    }
+    class_loader::impl::GraveyardStatistics graveyard =
+      class_loader::impl::getGraveyardStatistics();
+    if (0 == i) {
+      buried = graveyard.meta_objects;
+    }
+    EXPECT_EQ(buried, graveyard.meta_objects);
+  }
+
+#ifdef __linux__
+  // Only a library that is still in memory keeps its MetaObjects around to be revived
+  void * handle = dlopen(LIBRARY_1.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  if (nullptr == handle) {
+    EXPECT_GT(class_loader::impl::getGraveyardStatistics().reclaimed, 0u);
+  } else {
+    dlclose(handle);
+    EXPECT_GT(class_loader::impl::getGraveyardStatistics().bytes, 0u);
+  }
+#endif
+}
+
+TEST(ClassLoaderTest, ownershipIsTrackedPerLibrary) {
+  const std::string library_path = class_loader::impl::getCanonicalLibraryPath(LIBRARY_1);
+  std::vector<std::unique_ptr<class_loader::ClassLoader>> loaders;
+  for (int i = 0; i < 50; ++i) {
+    loaders.emplace_back(new class_loader::ClassLoader(LIBRARY_1, false));
+  }
+  EXPECT_EQ(loaders.size(), class_loader::impl::getLibraryOwners(library_path).size());
+  for (auto & loader : loaders) {
+    EXPECT_TRUE(class_loader::impl::isLibraryOwnedBy(library_path, loader.get()));
+  }
+  loaders.back()->createUniqueInstance<Base>("Cat")->saySomething();
+
+  // Dropping a loader only unbinds it, the factories stay available to the others
+  const class_loader::ClassLoader * dropped = loaders.back().get();
+  loaders.pop_back();
+  EXPECT_FALSE(class_loader::impl::isLibraryOwnedBy(library_path, dropped));
+  EXPECT_EQ(loaders.size(), class_loader::impl::getLibraryOwners(library_path).size());
+  loaders.front()->createUniqueInstance<Base>("Dog")->saySomething();
+
+  loaders.clear();
+  EXPECT_FALSE(class_loader::impl::isLibraryOwnedByAnybody(library_path));
+  EXPECT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+}
+
 TEST(ClassLoaderTest, loadRefCountingNonLazy) {
   try {
     class_loader::ClassLoader loader1(LIBRARY_1, false);
@@ -269,6 +646,201 @@ TEST(ClassLoaderTest, loadRefCountingLazy) {
   FAIL() << "Did not throw exception as expected.\n";
 }
 
+TEST(ClassLoaderTest, librariesUsedByClassLoader) {
+  class_loader::ClassLoader loader1(LIBRARY_1, false);
+  class_loader::ClassLoader loader2(LIBRARY_1, false);
+  ASSERT_EQ(std::vector<std::string>(1, LIBRARY_1),
+    class_loader::impl::getAllLibrariesUsedByClassLoader(&loader1));
+  ASSERT_EQ(std::vector<std::string>(1, LIBRARY_1),
+    class_loader::impl::getAllLibrariesUsedByClassLoader(&loader2));
+
+  loader1.unloadLibrary();
+  ASSERT_TRUE(class_loader::impl::getAllLibrariesUsedByClassLoader(&loader1).empty());
+  ASSERT_FALSE(loader1.isClassAvailable<Base>("Cat"));
+  ASSERT_TRUE(loader2.isClassAvailable<Base>("Cat"));
+  ASSERT_TRUE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+
+  loader2.unloadLibrary();
+  ASSERT_TRUE(class_loader::impl::getAllLibrariesUsedByClassLoader(&loader2).empty());
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+}
+
+TEST(ClassLoaderTest, factoryKeepsLibraryLoaded) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  EXPECT_THROW(loader1.getFactory<Base>("Bear"), class_loader::CreateClassException);
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+
+  {
+    class_loader::ClassLoader::Factory<Base> factory = loader1.getFactory<Base>("Cat");
+    ASSERT_TRUE(factory.valid());
+    ASSERT_EQ("Cat", factory.className());
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+
+    factory.createUnique()->saySomething();
+    factory.createShared()->saySomething();
+    // The instances are gone but the factory still pins the library
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+
+    std::shared_ptr<Base> obj;
+    {
+      class_loader::ClassLoader::Factory<Base> moved = std::move(factory);
+      ASSERT_FALSE(factory.valid());
+      obj = moved.createShared();
+    }
+    // The instance outlives the factory it was created by
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+    obj->saySomething();
+  }
+
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+}
+
+TEST(ClassLoaderTest, createInstancesContiguously) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  ASSERT_TRUE(loader1.createInstances<Base>("Cat", 0).empty());
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+
+  {
+    class_loader::ClassLoader::InstanceArray<Base> cats = loader1.createInstances<Base>("Cat", 3);
+    ASSERT_EQ(3u, cats.size());
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+
+    const char * first = reinterpret_cast<const char *>(&cats[0]);
+    const std::ptrdiff_t stride = reinterpret_cast<const char *>(&cats[1]) - first;
+    ASSERT_GE(stride, static_cast<std::ptrdiff_t>(sizeof(Base)));
+    std::size_t count = 0;
+    for (Base & cat : cats) {
+      ASSERT_EQ(first + stride * count, reinterpret_cast<const char *>(&cat));
+      cat.saySomething();
+      ++count;
+    }
+    ASSERT_EQ(3u, count);
+
+    class_loader::ClassLoader::InstanceArray<Base> moved = std::move(cats);
+    ASSERT_TRUE(cats.empty());
+    ASSERT_EQ(3u, moved.size());
+    ASSERT_TRUE(loader1.isLibraryLoaded());
+  }
+
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+}
+
+TEST(ClassLoaderTest, pooledInstancesAreRecycled) {
+  class_loader::ClassLoader loader2(LIBRARY_2, true);
+  {
+    class_loader::ClassLoader::Factory<Base> factory = loader2.getFactory<Base>("Drone");
+    class_loader::impl::InstancePool::Statistics before = factory.getPoolStatistics();
+    Base * first = nullptr;
+    {
+      class_loader::ClassLoader::PooledPtr<Base> drone = factory.createPooled();
+      first = drone.get();
+    }
+    {
+      class_loader::ClassLoader::PooledPtr<Base> drone =
+        loader2.createPooledInstance<Base>("Drone");
+      ASSERT_EQ(first, drone.get());
+      class_loader::ClassLoader::PooledPtr<Base> other = factory.createPooled();
+      ASSERT_NE(first, other.get());
+      other->saySomething();
+    }
+    class_loader::impl::InstancePool::Statistics after = factory.getPoolStatistics();
+    ASSERT_EQ(1u, after.hits - before.hits);
+    ASSERT_EQ(2u, after.misses - before.misses);
+    ASSERT_EQ(2u, after.idle);
+  }
+
+  // The pool is emptied when the library is unloaded
+  ASSERT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_2));
+  class_loader::ClassLoader::Factory<Base> factory = loader2.getFactory<Base>("Drone");
+  ASSERT_EQ(0u, factory.getPoolStatistics().idle);
+
+  // Without a reset hook only the storage is recycled
+  class_loader::ClassLoader loader1(LIBRARY_1, false);
+  Base * first = loader1.createPooledInstance<Base>("Cat").get();
+  ASSERT_EQ(first, loader1.createPooledInstance<Base>("Cat").get());
+}
+
+TEST(ClassLoaderTest, createInPlace) {
+  class_loader::ClassLoader loader1(LIBRARY_1, true);
+  alignas(64) unsigned char buffer[256];
+  {
+    class_loader::ClassLoader::Factory<Base> factory = loader1.getFactory<Base>("Cat");
+    ASSERT_LE(factory.objectSize(), sizeof(buffer) - 1);
+    EXPECT_THROW(
+      factory.createInPlace(buffer, factory.objectSize() - 1), class_loader::CreateClassException);
+    // The object is moved up to the next suitably aligned address
+    EXPECT_THROW(
+      factory.createInPlace(buffer + 1, factory.objectSize()), class_loader::CreateClassException);
+  }
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+
+  class_loader::ClassLoader::InPlacePtr<Base> cat =
+    loader1.createInPlace<Base>("Cat", buffer, sizeof(buffer));
+  ASSERT_TRUE(static_cast<bool>(cat));
+  ASSERT_GE(reinterpret_cast<unsigned char *>(cat.get()), buffer);
+  ASSERT_LT(reinterpret_cast<unsigned char *>(cat.get()), buffer + sizeof(buffer));
+  cat->saySomething();
+  ASSERT_TRUE(loader1.isLibraryLoaded());
+
+  cat.destroy();
+  ASSERT_FALSE(static_cast<bool>(cat));
+  ASSERT_FALSE(loader1.isLibraryLoaded());
+}
+
+#ifdef __linux__
+TEST(ClassLoaderTest, classOperatorNew) {
+  class_loader::ClassLoader loader2(LIBRARY_2, false);
+  void * handle = dlopen(LIBRARY_2.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+  ASSERT_TRUE(nullptr != handle);
+  typedef std::size_t (* AllocationCount)();
+  AllocationCount allocations =
+    reinterpret_cast<AllocationCount>(dlsym(handle, "hoarderAllocations"));
+  ASSERT_TRUE(nullptr != allocations);
+  const std::size_t before = allocations();
+
+  // Shared and pooled instances are allocated by the class like any other
+  loader2.createSharedInstance<Base>("Hoarder")->saySomething();
+  loader2.createPooledInstance<Base>("Hoarder")->saySomething();
+  loader2.createUniqueInstance<Base>("Hoarder")->saySomething();
+  EXPECT_EQ(3u, allocations() - before);
+
+  // Batches and objects constructed in place live in storage the class does not allocate
+  EXPECT_EQ(2u, loader2.createInstances<Base>("Hoarder", 2).size());
+  alignas(64) unsigned char buffer[256];
+  loader2.createInPlace<Base>("Hoarder", buffer, sizeof(buffer)).destroy();
+  EXPECT_EQ(3u, allocations() - before);
+  dlclose(handle);
+}
+#endif
+
+TEST(ClassLoaderTest, availableClassesWithoutCopies) {
+  class_loader::ClassLoader loader1(LIBRARY_1, false);
+  ASSERT_TRUE(loader1.isClassAvailable<Base>("Cat"));
+  ASSERT_FALSE(loader1.isClassAvailable<Base>("Bear"));
+  ASSERT_FALSE(loader1.isClassAvailable<Base>("Robot"));
+
+  std::vector<std::string> visited;
+  loader1.forEachAvailableClass<Base>([&visited](const std::string & class_name) {
+      visited.push_back(class_name);
+    });
+  std::vector<std::string> available = loader1.getAvailableClasses<Base>();
+  std::sort(visited.begin(), visited.end());
+  std::sort(available.begin(), available.end());
+  ASSERT_EQ(available, visited);
+
+  class_loader::MultiLibraryClassLoader loader(false);
+  loader.loadLibrary(LIBRARY_1);
+  loader.loadLibrary(LIBRARY_2);
+  ASSERT_TRUE(loader.isClassAvailable<Base>("Cat"));
+  ASSERT_TRUE(loader.isClassAvailable<Base>("Robot"));
+  ASSERT_FALSE(loader.isClassAvailable<Base>("Bear"));
+  size_t count = 0;
+  loader.forEachAvailableClass<Base>([&count](const std::string &) {++count;});
+  ASSERT_EQ(loader.getAvailableClasses<Base>().size(), count);
+}
+
 void testMultiClassLoader(bool lazy)
 {
   try {
@@ -287,6 +859,156 @@ void testMultiClassLoader(bool lazy)
   SUCCEED();
 }
 
+TEST(MultiClassLoaderTest, classIndexFollowsLoadedLibraries) {
+  class_loader::MultiLibraryClassLoader loader(false);
+  loader.loadLibrary(LIBRARY_1);
+  loader.createUniqueInstance<Base>("Cat")->saySomething();
+  EXPECT_THROW(loader.createUniqueInstance<Base>("Robot"), class_loader::CreateClassException);
+
+  loader.loadLibrary(LIBRARY_2);
+  loader.createUniqueInstance<Base>("Robot")->saySomething();
+
+  loader.unloadLibrary(LIBRARY_2);
+  EXPECT_THROW(loader.createUniqueInstance<Base>("Robot"), class_loader::CreateClassException);
+  loader.createUniqueInstance<Base>("Cat")->saySomething();
+}
+
+TEST(MultiClassLoaderTest, concurrentCreateWhileLoadingAndUnloading) {
+  class_loader::MultiLibraryClassLoader loader(false);
+  loader.loadLibrary(LIBRARY_1);
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (std::size_t c = 0; c < 4; ++c) {
+    threads.emplace_back([&loader, &stop]() {
+        while (!stop.load()) {
+          EXPECT_TRUE(loader.isClassAvailable<Base>("Cat"));
+          EXPECT_TRUE(nullptr != loader.createUniqueInstance<Base>("Cat"));
+        }
+      });
+  }
+
+  for (std::size_t c = 0; c < 50; ++c) {
+    loader.loadLibrary(LIBRARY_2);
+    EXPECT_TRUE(nullptr != loader.createUniqueInstance<Base>("Robot"));
+    EXPECT_EQ(0, loader.unloadLibrary(LIBRARY_2));
+  }
+  stop.store(true);
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(std::vector<std::string>(1, LIBRARY_1), loader.getRegisteredLibraries());
+}
+
+TEST(MultiClassLoaderTest, loadLibrariesReportsEachLibrary) {
+  class_loader::MultiLibraryClassLoader loader(false);
+  std::vector<std::string> library_paths = {LIBRARY_1, "libDoesNotExist.so", LIBRARY_2};
+  std::vector<class_loader::LibraryLoadResult> results = loader.loadLibraries(library_paths, 2);
+
+  ASSERT_EQ(3u, results.size());
+  for (size_t c = 0; c < results.size(); c++) {
+    EXPECT_EQ(library_paths[c], results[c].library_path);
+  }
+  EXPECT_TRUE(results[0].loaded);
+  EXPECT_TRUE(results[0].error.empty());
+  EXPECT_FALSE(results[1].loaded);
+  EXPECT_FALSE(results[1].error.empty());
+  EXPECT_TRUE(results[2].loaded);
+
+  loader.createUniqueInstance<Base>("Cat")->saySomething();
+  loader.createUniqueInstance<Base>("Robot")->saySomething();
+  EXPECT_EQ(2u, loader.getRegisteredLibraries().size());
+
+  class_loader::MultiLibraryClassLoader on_demand_loader(true);
+  results = on_demand_loader.loadLibraries(library_paths, 2);
+  ASSERT_EQ(3u, results.size());
+  EXPECT_TRUE(results[0].loaded);
+  EXPECT_FALSE(results[1].loaded);
+  EXPECT_FALSE(results[1].error.empty());
+  EXPECT_TRUE(results[2].loaded);
+  EXPECT_EQ(2u, on_demand_loader.getRegisteredLibraries().size());
+  on_demand_loader.createUniqueInstance<Base>("Robot")->saySomething();
+}
+
+TEST(MultiClassLoaderTest, failedIndexingIsRetried) {
+  class_loader::MultiLibraryClassLoader loader(true);
+  loader.loadLibrary(LIBRARY_1);
+  loader.loadLibrary("libDoesNotExist.so");
+  // Each lookup tries to load the library again rather than using a partial class index
+  for (int c = 0; c < 2; ++c) {
+    EXPECT_THROW(loader.createUniqueInstance<Base>("Cat"), class_loader::LibraryLoadException);
+  }
+  loader.unloadLibrary("libDoesNotExist.so");
+  loader.createUniqueInstance<Base>("Cat")->saySomething();
+}
+
+TEST(MultiClassLoaderTest, loadLibraryAsync) {
+  class_loader::MultiLibraryClassLoader loader(false);
+  std::vector<std::function<void()>> tasks;
+  class_loader::LoadExecutor deferred = [&tasks](const std::function<void()> & task) {
+      tasks.push_back(task);
+    };
+
+  std::shared_future<void> loaded = loader.loadLibraryAsync(LIBRARY_2, deferred);
+  // Asking again while the load is pending does not start another one
+  loader.loadLibraryAsync(LIBRARY_2, deferred);
+  ASSERT_EQ(1u, tasks.size());
+  EXPECT_EQ(std::future_status::timeout, loaded.wait_for(std::chrono::seconds(0)));
+
+  // Creating an instance waits for the pending load
+  std::thread client([&loader]() {
+      loader.createUniqueInstance<Base>("Robot")->saySomething();
+    });
+  tasks.front()();
+  client.join();
+  loaded.get();
+
+  std::shared_future<void> failed =
+    loader.loadLibraryAsync("libDoesNotExist.so", class_loader::makeThreadLoadExecutor(true));
+  EXPECT_THROW(failed.get(), class_loader::LibraryLoadException);
+  EXPECT_THROW(loader.createUniqueInstance<Base>("Cat"), class_loader::CreateClassException);
+}
+
+TEST(MultiClassLoaderTest, memoryBudgetEvictsIdleLibraries) {
+  class_loader::MultiLibraryClassLoader loader(false);
+  loader.loadLibrary(LIBRARY_1);
+  loader.loadLibrary(LIBRARY_2);
+  class_loader::ClassLoader::UniquePtr<Base> cat = loader.createUniqueInstance<Base>("Cat");
+
+  // No library fits, so every one without live instances goes
+  loader.setMemoryBudget(1);
+  for (int c = 0; c < 1000 && 0 == loader.getEvictionStatistics().evictions; ++c) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  class_loader::LibraryEvictionStatistics statistics = loader.getEvictionStatistics();
+  EXPECT_EQ(1u, statistics.evictions);
+  EXPECT_LT(0u, statistics.mapped_bytes);
+  EXPECT_TRUE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+  EXPECT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_2));
+
+  // The evicted library is still bound and loaded again when needed
+  EXPECT_EQ(2u, loader.getRegisteredLibraries().size());
+  loader.createUniqueInstance<Base>("Robot")->saySomething();
+  statistics = loader.getEvictionStatistics();
+  EXPECT_EQ(1u, statistics.reloads);
+  EXPECT_LT(0, statistics.max_reload_time.count());
+
+  cat.reset();
+  loader.enforceMemoryBudget();
+  EXPECT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_1));
+  EXPECT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_2));
+
+  // Rebuilding the class index leaves the evicted library alone until a class of it is needed,
+  // and a class no library provides does not load it either
+  loader.unloadLibrary(LIBRARY_1);
+  EXPECT_TRUE(loader.isClassAvailable<Base>("Robot"));
+  EXPECT_THROW(
+    loader.createUniqueInstance<Base>("Unicorn"), class_loader::CreateClassException);
+  EXPECT_FALSE(class_loader::impl::isLibraryLoadedByAnybody(LIBRARY_2));
+  loader.createUniqueInstance<Base>("Robot")->saySomething();
+  EXPECT_EQ(2u, loader.getEvictionStatistics().reloads);
+}
+
 TEST(MultiClassLoaderTest, lazyLoad) {
   testMultiClassLoader(true);
 }